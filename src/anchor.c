@@ -0,0 +1,245 @@
+/***************************************************************************//**
+
+  @file         anchor.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Zero-width assertions, and patterns anchored by them.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on assertions:
+
+  "^", "$", "\A" and "\z" become Assert instructions, which match the empty
+  string at the beginning of a line, the end of a line, the beginning of the
+  text and the end of the text respectively.  Whether each of them holds at a
+  string index depends only on the bytes on either side of it, so the engines
+  find the conditions for an index once (with lookaround()), and follow an
+  Assert during the epsilon closure when its bit is set.
+
+  When a program is created, we also check whether every match has to begin at
+  the beginning of the text or of a line, and whether every match has to end
+  at the end of the text.  A search can then only start threads at index 0 (or
+  just after each newline), and a search for a pattern which must end at the
+  end of the text can be run backwards from there (see search_bytes()).
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+/**
+   @brief Return the assertions which hold between two bytes.
+   @param prev The byte before the index, or -1 at the beginning of the text.
+   @param next The byte after the index, or -1 at the end of the text.
+ */
+unsigned lookaround(int prev, int next)
+{
+  unsigned ctx = 0;
+  if (prev < 0) {
+    ctx |= BeginText | BeginLine;
+  } else if (prev == '\n') {
+    ctx |= BeginLine;
+  }
+  if (next < 0) {
+    ctx |= EndText | EndLine;
+  } else if (next == '\n') {
+    ctx |= EndLine;
+  }
+  return ctx;
+}
+
+/**
+   @brief Return the assertions which hold at an index of a buffer.
+ */
+unsigned lookaround_at(const unsigned char *buf, size_t len, size_t sp)
+{
+  return lookaround(sp > 0 ? buf[sp - 1] : -1, sp < len ? buf[sp] : -1);
+}
+
+/**
+   @brief Find which assertions every match begins with.
+
+   Every path from the start must reach an Assert for the beginning of the text
+   or of a line before it consumes anything.
+ */
+static unsigned begin_anchors(const program *p)
+{
+  sparse_set visited;
+  instr **stack = calloc(p->n + 1, sizeof(instr *));
+  size_t nstack = 0;
+  unsigned anchors = BeginText;
+
+  ss_init(&visited, p->n);
+  stack[nstack++] = p->code;
+  while (anchors && nstack > 0) {
+    instr *pc = stack[--nstack];
+    while (pc != NULL) {
+      size_t idx = pc - p->code;
+      if (ss_contains(&visited, idx)) {
+        break;
+      }
+      ss_insert(&visited, idx);
+
+      if (pc->code == Jump) {
+        pc = pc->x;
+      } else if (pc->code == Split) {
+        stack[nstack++] = pc->y;
+        pc = pc->x;
+      } else if (pc->code == Save ||
+                 (pc->code == Assert && !(pc->s & (BeginText | BeginLine)))) {
+        pc = pc + 1;
+      } else if (pc->code == Assert) {
+        // The beginning of the text is also the beginning of a line.
+        if (pc->s == BeginLine) {
+          anchors = BeginLine;
+        }
+        pc = NULL;
+      } else {
+        anchors = 0;
+        pc = NULL;
+      }
+    }
+  }
+
+  ss_free(&visited);
+  free(stack);
+  return anchors;
+}
+
+/**
+   @brief Return whether every match ends with an Assert for the end of the text.
+
+   This explores pairs of (instruction, whether the end of the text has been
+   asserted since the last byte was consumed), so it takes linear time.
+ */
+static bool end_anchored(const program *p)
+{
+  bool *visited = calloc(2 * p->n, sizeof(bool));
+  size_t *stack = calloc(4 * p->n + 1, sizeof(size_t));
+  size_t nstack = 0;
+  bool anchored = true;
+
+  stack[nstack++] = 0;
+  while (anchored && nstack > 0) {
+    size_t state = stack[--nstack];
+    if (visited[state]) {
+      continue;
+    }
+    visited[state] = true;
+
+    instr *pc = &p->code[state / 2];
+    size_t asserted = state % 2;
+    switch (pc->code) {
+    case Match:
+      anchored = asserted;
+      break;
+    case Jump:
+      stack[nstack++] = 2 * (pc->x - p->code) + asserted;
+      break;
+    case Split:
+      stack[nstack++] = 2 * (pc->y - p->code) + asserted;
+      stack[nstack++] = 2 * (pc->x - p->code) + asserted;
+      break;
+    case Assert:
+      stack[nstack++] = state + 2 + (pc->s == EndText ? 1 - asserted : 0);
+      break;
+    case Save:
+      stack[nstack++] = state + 2;
+      break;
+    default:
+      // Nothing can be consumed after the end of the text, so a thread which
+      // asserted it dies here.
+      if (!asserted) {
+        stack[nstack++] = 2 * (pc - p->code + 1);
+      }
+      break;
+    }
+  }
+
+  free(visited);
+  free(stack);
+  return anchored;
+}
+
+/**
+   @brief Find the assertions in a program, and how its matches are anchored.
+
+   Sets p->assertions and p->anchors.
+ */
+void anchor_compile(program *p)
+{
+  p->assertions = 0;
+  for (size_t i = 0; i < p->n; i++) {
+    if (p->code[i].code == Assert) {
+      p->assertions |= p->code[i].s;
+    }
+  }
+
+  p->anchors = 0;
+  if (p->assertions & (BeginText | BeginLine)) {
+    p->anchors |= begin_anchors(p);
+  }
+  if ((p->assertions & EndText) && end_anchored(p)) {
+    p->anchors |= EndText;
+  }
+}
+
+/**
+   @brief Return whether a program's anchors allow a match to begin at an index.
+ */
+bool anchor_allows(const program *p, const unsigned char *buf, size_t sp)
+{
+  if (p->anchors & BeginText) {
+    return sp == 0;
+  } else if (p->anchors & BeginLine) {
+    return sp == 0 || buf[sp - 1] == '\n';
+  }
+  return true;
+}
+
+/**
+   @brief Find the next index where a match could begin.
+
+   This combines the program's anchors with a prefilter.
+   @param p Program being searched for.
+   @param pf Prefilter to use (may be NULL).
+   @param buf Bytes to search.
+   @param len Number of bytes in buf.
+   @param sp Index to start looking from.
+   @returns The first candidate index at or after sp, or len + 1 if there is
+   none.
+ */
+size_t anchor_next(const program *p, const prefilter *pf,
+                   const unsigned char *buf, size_t len, size_t sp)
+{
+  while (sp <= len) {
+    if (pf) {
+      sp = prefilter_next(pf, buf, len, sp);
+      if (sp > len) {
+        break;
+      }
+    }
+    if (anchor_allows(p, buf, sp)) {
+      return sp;
+    }
+    if (p->anchors & BeginText) {
+      break;
+    }
+    // Skip to the beginning of the next line.
+    const unsigned char *nl = memchr(buf + sp, '\n', len - sp);
+    if (nl == NULL) {
+      break;
+    }
+    sp = nl - buf + 1;
+  }
+  return len + 1;
+}
@@ -0,0 +1,226 @@
+/***************************************************************************//**
+
+  @file         backtrack.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Bounded backtracking matcher for short inputs.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on bounded backtracking:
+
+  A backtracking matcher explores threads one at a time, depth first, in
+  priority order.  So the first Match it reaches is the one the Pike VM would
+  report.  Ordinarily, backtracking can take exponential time, but we remember
+  every (instruction, string index) pair we have explored in a bitmap.  If we
+  get there again, we know it leads nowhere (if it led to a match, we would
+  have stopped), so no pair is explored twice.  This is the same rule the Pike
+  VM uses to drop duplicate threads.
+
+  The bitmap needs a bit for each instruction at each string index, so this is
+  only used when that is small.  Then, it avoids the setup cost of the Pike VM
+  (thread lists and capture matrices sized for the whole program).
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+/*
+  Largest bitmap (in bits) we are willing to use: 32KiB.
+ */
+#define BACKTRACK_BUDGET (256 * 1024)
+
+/*
+  Entry on the backtracking stack: either a thread to explore later, or (when
+  pc is NULL) a capture slot to restore.
+ */
+typedef struct btjob btjob;
+struct btjob {
+  instr *pc;
+  size_t sp;
+  size_t slot;
+  uint32_t value;
+};
+
+struct bitstate {
+  uint32_t *visited;  // one bit per (instruction, string index)
+  size_t avisited;    // allocated words
+  btjob *stack;
+  size_t nstack, astack;
+  uint32_t *caps;     // captures of the thread being explored
+  size_t nslot;       // capture slots, plus one for the match start
+};
+
+/**
+   @brief Allocate working memory for backtracking on a program.
+
+   The bitmap is grown as needed by backtrack(), up to BACKTRACK_BUDGET bits.
+ */
+bitstate *newbitstate(const program *p)
+{
+  bitstate *b = calloc(1, sizeof(bitstate));
+  b->nslot = p->nsave + 1;
+  b->caps = calloc(b->nslot, sizeof(uint32_t));
+  b->astack = 16;
+  b->stack = calloc(b->astack, sizeof(btjob));
+  return b;
+}
+
+void free_bitstate(bitstate *b)
+{
+  free(b->visited);
+  free(b->stack);
+  free(b->caps);
+  free(b);
+}
+
+/**
+   @brief Return whether backtracking fits in the budget for this input.
+   @param proglen Number of instructions in the program.
+   @param len Length of the input.
+ */
+bool backtrack_fits(size_t proglen, size_t len)
+{
+  return (len + 1) <= BACKTRACK_BUDGET / (proglen ? proglen : 1);
+}
+
+static void push(bitstate *b, btjob j)
+{
+  if (b->nstack >= b->astack) {
+    b->astack *= 2;
+    b->stack = realloc(b->stack, b->astack * sizeof(btjob));
+  }
+  b->stack[b->nstack++] = j;
+}
+
+/**
+   @brief Explore every thread from one starting index, in priority order.
+   @returns The end of the first match found, or -1.
+ */
+static ssize_t try(const program *p, bitstate *b, const unsigned char *buf,
+                   size_t len, size_t start)
+{
+  push(b, (btjob){p->code, start, 0, 0});
+
+  while (b->nstack > 0) {
+    btjob j = b->stack[--b->nstack];
+    if (j.pc == NULL) {
+      b->caps[j.slot] = j.value;
+      continue;
+    }
+
+    instr *pc = j.pc;
+    size_t sp = j.sp;
+    while (pc != NULL) {
+      size_t bit = (pc - p->code) * (len + 1) + sp;
+      if (b->visited[bit / 32] & (1u << (bit % 32))) {
+        break;
+      }
+      b->visited[bit / 32] |= 1u << (bit % 32);
+
+      switch (pc->code) {
+      case Char:
+      case Any:
+      case Range:
+      case NRange:
+        if (sp < len && accepts(pc, buf[sp])) {
+          pc++;
+          sp++;
+        } else {
+          pc = NULL;
+        }
+        break;
+      case String:
+        // Compare the whole run at once, and skip the Chars after it.
+        if (sp + pc->s <= len && memcmp(buf + sp, pc->x, pc->s) == 0) {
+          sp += pc->s;
+          pc += pc->s;
+        } else {
+          pc = NULL;
+        }
+        break;
+      case Jump:
+        pc = pc->x;
+        break;
+      case Split:
+        push(b, (btjob){pc->y, sp, 0, 0});
+        pc = pc->x;
+        break;
+      case Save:
+        push(b, (btjob){NULL, 0, pc->s, b->caps[pc->s]});
+        b->caps[pc->s] = sp;
+        pc++;
+        break;
+      case Assert:
+        pc = (lookaround_at(buf, len, sp) & pc->s) ? pc + 1 : NULL;
+        break;
+      case Match:
+        b->nstack = 0;
+        return sp;
+      }
+    }
+  }
+  return -1;
+}
+
+/**
+   @brief Match a program by bounded backtracking.
+
+   Gives the same result as the Pike VM.  The caller must check that the input
+   fits with backtrack_fits() first.
+   @param p Program to match.
+   @param b Working memory from newbitstate().
+   @param buf Bytes to match.
+   @param len Number of bytes in buf.
+   @param anchored Whether the match must begin at the start of input.
+   @param[out] matched Where to put the captures of the match, followed by the
+   index where the match starts (nsave + 1 slots).
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t backtrack(const program *p, bitstate *b, const unsigned char *buf,
+                  size_t len, bool anchored, uint32_t *matched)
+{
+  size_t nwords = (p->n * (len + 1) + 31) / 32;
+  if (nwords > b->avisited) {
+    free(b->visited);
+    b->visited = calloc(nwords, sizeof(uint32_t));
+    b->avisited = nwords;
+  } else {
+    memset(b->visited, 0, nwords * sizeof(uint32_t));
+  }
+
+  // A pair which failed from an earlier start fails from later ones too, so
+  // the bitmap is not cleared between starting indices.  When searching, the
+  // prefilter (if any) and the program's anchors pick out the starting indices
+  // worth trying.
+  const prefilter *pf = anchored ? NULL : p->prefilter;
+  for (size_t start = 0; start <= len; start++) {
+    if (!anchored) {
+      start = anchor_next(p, pf, buf, len, start);
+      if (start > len) {
+        break;
+      }
+    }
+    memset(b->caps, 0, b->nslot * sizeof(uint32_t));
+    b->caps[p->nsave] = start;
+    ssize_t match = try(p, b, buf, len, start);
+    if (match != -1) {
+      memcpy(matched, b->caps, b->nslot * sizeof(uint32_t));
+      return match;
+    }
+    if (anchored) {
+      break;
+    }
+  }
+  return -1;
+}
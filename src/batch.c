@@ -0,0 +1,94 @@
+/***************************************************************************//**
+
+  @file         batch.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Matching one program against a column of strings.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on batches:
+
+  Columnar data (like an Arrow string column) stores many short strings back to
+  back in one data buffer, with an array of offsets: row i is the bytes from
+  offsets[i] up to offsets[i+1].  Matching row by row with execute() would
+  allocate a scratch (and need a NUL-terminated copy) for every row.  Instead,
+  match_batch() runs the byte-oriented entry points directly on each row, with
+  one scratch for the whole batch.
+
+  When no spans are requested, each row only needs a yes or no answer, so
+  is_match() is used.  Otherwise run_bytes() or search_bytes() are used, which
+  don't allocate when no captures are requested.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+/**
+   @brief Match a program against every row of a string column.
+   @param p Program to match.
+   @param s Scratch allocated for this program by newscratch().
+   @param data Bytes of every row, back to back.
+   @param offsets Start of each row in data, followed by the end of the last
+   row (nrows + 1 entries).
+   @param nrows Number of rows.
+   @param anchored Whether matches must begin at the start of each row (as in
+   run_bytes()), rather than anywhere in it (as in search_bytes()).
+   @param[out] out Where to put the results.  Any of its arrays may be NULL.
+   @returns The number of rows which matched.
+ */
+size_t match_batch(const program *p, scratch *s, const unsigned char *data,
+                   const size_t *offsets, size_t nrows, bool anchored,
+                   batchresult *out)
+{
+  bool spans = out->starts != NULL || out->ends != NULL;
+  size_t nmatch = 0;
+
+  if (out->bitmap) {
+    memset(out->bitmap, 0, (nrows + 7) / 8);
+  }
+
+  for (size_t i = 0; i < nrows; i++) {
+    const unsigned char *row = data + offsets[i];
+    size_t len = offsets[i + 1] - offsets[i];
+    size_t start = 0;
+    ssize_t end = -1;
+    bool matched;
+
+    if (!spans) {
+      matched = is_match(p, s, row, len, anchored);
+    } else {
+      end = anchored ? run_bytes(p, s, row, len, NULL)
+                     : search_bytes(p, s, row, len, &start, NULL);
+      matched = end != -1;
+    }
+
+    if (out->starts) {
+      out->starts[i] = matched ? start : 0;
+    }
+    if (out->ends) {
+      out->ends[i] = end;
+    }
+    if (!matched) {
+      continue;
+    }
+    if (out->bitmap) {
+      out->bitmap[i / 8] |= 1 << (i % 8);
+    }
+    if (out->selection) {
+      out->selection[nmatch] = i;
+    }
+    nmatch++;
+  }
+  return nmatch;
+}
@@ -0,0 +1,113 @@
+/***************************************************************************//**
+
+  @file         charset.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Character classes, as 256-bit membership bitmaps.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on character sets:
+
+  Range and NRange instructions point to a charset: a bitmap with one bit for
+  each byte value.  Classes are written as lists of ranges, but those are
+  lowered to a bitmap when code is generated (or read), so testing a byte is a
+  single bit lookup no matter how many ranges the class had.  NRange uses the
+  same bitmap as Range, and just inverts the result.
+
+  The sets for \d, \w and \s are static, and shared by every instruction which
+  uses them (including \D, \W and \S).  So, free_charset() must be used rather
+  than free(), since it leaves those alone.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+// [0-9]
+static const unsigned char digit[CHARSET_BYTES] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x03,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// [a-zA-Z0-9_]
+static const unsigned char word[CHARSET_BYTES] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x03,
+  0xfe, 0xff, 0xff, 0x87, 0xfe, 0xff, 0xff, 0x07,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// [ \t\n\r\f\v]
+static const unsigned char space[CHARSET_BYTES] = {
+  0x00, 0x3e, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/**
+   @brief Allocate an empty charset.
+ */
+unsigned char *newcharset(void)
+{
+  return calloc(CHARSET_BYTES, sizeof(unsigned char));
+}
+
+/**
+   @brief Free a charset, unless it is one of the shared ones.
+ */
+void free_charset(unsigned char *set)
+{
+  if (set != digit && set != word && set != space) {
+    free(set);
+  }
+}
+
+/**
+   @brief Add the bytes from lo to hi (inclusive) to a charset.
+ */
+void charset_add(unsigned char *set, unsigned char lo, unsigned char hi)
+{
+  for (int c = lo; c <= hi; c++) {
+    set[c >> 3] |= 1 << (c & 7);
+  }
+}
+
+/**
+   @brief Return whether a charset contains a byte.
+ */
+bool charset_has(const unsigned char *set, unsigned char c)
+{
+  return set[c >> 3] & (1 << (c & 7));
+}
+
+/**
+   @brief Return the shared charset for a special class.
+   @param type One of 'd', 'w' or 's' (the negated classes use the same set).
+   @returns The charset, or NULL for anything else.
+ */
+unsigned char *charset_special(char type)
+{
+  // The shared sets are never written or freed, so dropping const is safe.
+  switch (type) {
+  case 'd':
+    return (unsigned char *) digit;
+  case 'w':
+    return (unsigned char *) word;
+  case 's':
+    return (unsigned char *) space;
+  default:
+    return NULL;
+  }
+}
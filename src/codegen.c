@@ -48,6 +48,7 @@ typedef struct State State;
 struct State {
   intptr_t id; // "global" id counter
   size_t capture; // capture parentheses counter
+  bool reverse; // generate code matching the reversed string, without saves
 };
 
 static Fragment *last(Fragment *f)
@@ -143,31 +144,28 @@ static Fragment *special(char type, State *s)
 {
   Fragment *f;
 
-  char whitespace[] = "  \t\t\n\n\r\r\f\f\v\v";
-  char word[] = "azAZ09__";
-  char number[] = "09";
-
+  // The charsets are shared, so nothing is allocated for them.
   switch (type) {
   case 's':
   case 'S':
     f = (type == 's') ? newfrag(Range, s) : newfrag(NRange, s);
-    f->in.s = nelem(whitespace) / 2;
-    f->in.x = calloc(nelem(whitespace), sizeof(char));
-    memcpy(f->in.x, whitespace, nelem(whitespace));
+    f->in.x = (instr *) charset_special('s');
     break;
   case 'w':
   case 'W':
     f = (type == 'w') ? newfrag(Range, s) : newfrag(NRange, s);
-    f->in.s = nelem(word) / 2;
-    f->in.x = calloc(nelem(word), sizeof(char));
-    memcpy(f->in.x, word, nelem(word));
+    f->in.x = (instr *) charset_special('w');
     break;
   case 'd':
   case 'D':
     f = (type == 'd') ? newfrag(Range, s) : newfrag(NRange, s);
-    f->in.s = nelem(number) / 2;
-    f->in.x = calloc(nelem(number), sizeof(char));
-    memcpy(f->in.x, number, nelem(number));
+    f->in.x = (instr *) charset_special('d');
+    break;
+  case 'A':
+  case 'z':
+    // Not a class at all, but the beginning or end of the text.
+    f = newfrag(Assert, s);
+    f->in.s = (type == 'A') ? BeginText : EndText;
     break;
   default:
     fprintf(stderr, "not implemented: special character class '%c'\n", type);
@@ -186,8 +184,7 @@ static Fragment *term(PTree *t, State *s)
   assert(t->nt == TERMnt);
 
   if (t->production == 1) {
-    if (t->children[0]->tok.sym == CharSym || t->children[0]->tok.sym == Caret
-        || t->children[0]->tok.sym == Minus) {
+    if (t->children[0]->tok.sym == CharSym || t->children[0]->tok.sym == Minus) {
       // Character
       f = newfrag(Char, s);
       f->in.c = t->children[0]->tok.c;
@@ -196,10 +193,19 @@ static Fragment *term(PTree *t, State *s)
       // Dot
       f = newfrag(Any, s);
       f->next = newfrag(Match, s);
+    } else if (t->children[0]->tok.sym == Caret ||
+               t->children[0]->tok.sym == Dollar) {
+      // Beginning or end of line
+      f = newfrag(Assert, s);
+      f->in.s = (t->children[0]->tok.sym == Caret) ? BeginLine : EndLine;
+      f->next = newfrag(Match, s);
     } else if (t->children[0]->tok.sym == Special) {
       // Special
       f = special(t->children[0]->tok.c, s);
     }
+  } else if (t->production == 2 && s->reverse) {
+    // Parenthesized expression, without captures
+    f = regex(t->children[1], s);
   } else if (t->production == 2) {
     // Parenthesized expression
     f = newfrag(Save, s);
@@ -216,12 +222,101 @@ static Fragment *term(PTree *t, State *s)
   return f;
 }
 
+/**
+   @brief Count the capturing parentheses in a tree.
+ */
+static size_t ngroups(PTree *t)
+{
+  size_t n = (t->nt == TERMnt && t->production == 2) ? 1 : 0;
+  for (size_t i = 0; i < t->nchildren; i++) {
+    if (t->children[i] != NULL) {
+      n += ngroups(t->children[i]);
+    }
+  }
+  return n;
+}
+
+/**
+   @brief Generate code for a counted repetition, by copying the term.
+
+   For {2,4}, and for {2,} (non-greedy versions swap the split targets):
+            BLOCK from term       L1:
+            BLOCK from term           BLOCK from term
+            split L1 L3               BLOCK from term
+        L1:                           split L1 L2
+            BLOCK from term       L2:
+            split L2 L3               match
+        L2:
+            BLOCK from term
+        L3:
+            match
+   Each copy uses the same capture slots, so a group reports its last
+   iteration, just like it would inside a star.
+ */
+static Fragment *repeat(PTree *t, State *s)
+{
+  unsigned min = t->children[1]->min, max = t->children[1]->max;
+  bool greedy = t->nchildren != 3;
+  size_t capture = s->capture;
+  size_t ncopy = max == REPEAT_INF ? (min > 0 ? min : 1) : max;
+  Fragment *end = newfrag(Match, s), *head = NULL, *prev = NULL;
+
+  if (ncopy == 0) {
+    // {0} matches the empty string.  Its groups keep their numbers, so the
+    // ones after it do too, but their slots are never set.
+    if (!s->reverse) {
+      s->capture += 2 * ngroups(t->children[0]);
+    }
+    head = newfrag(Jump, s);
+    head->in.x = (instr*) end->id;
+    head->next = end;
+    return head;
+  }
+
+  for (size_t i = 0; i < ncopy; i++) {
+    s->capture = capture;
+    Fragment *f = term(t->children[0], s);
+    if (i == 0 && fraglen(f) * ncopy > REGEX_MAX_UNROLL) {
+      fprintf(stderr, "error: repetition is larger than %d instructions\n",
+              REGEX_MAX_UNROLL);
+      exit(EXIT_FAILURE);
+    }
+    if (max == REPEAT_INF && i + 1 == ncopy) {
+      // The last copy loops.
+      Fragment *a = newfrag(Split, s), *b = newfrag(Match, s);
+      a->in.x = (instr*) (greedy ? f->id : b->id);
+      a->in.y = (instr*) (greedy ? b->id : f->id);
+      join(f, a);
+      a->next = b;
+    }
+    if (i >= min) {
+      // Copies after the minimum may be skipped.
+      Fragment *a = newfrag(Split, s);
+      a->in.x = (instr*) (greedy ? f->id : end->id);
+      a->in.y = (instr*) (greedy ? end->id : f->id);
+      a->next = f;
+      f = a;
+    }
+    if (prev == NULL) {
+      head = f;
+    } else {
+      join(prev, f);
+    }
+    prev = f;
+  }
+  join(prev, end);
+  return head;
+}
+
 static Fragment *expr(PTree *t, State *s)
 {
   Fragment *f = NULL, *a = NULL, *b = NULL, *c = NULL;
 
   assert(t->nt == EXPRnt);
 
+  if (t->nchildren > 1 && t->children[1]->tok.sym == Counted) {
+    return repeat(t, s);
+  }
   f = term(t->children[0], s);
   if (t->nchildren == 1) {
     return f;
@@ -313,6 +408,11 @@ static Fragment *sub(PTree *tree, State *state)
       BLOCK from s
      */
     Fragment *s = sub(tree->children[1], state);
+    if (state->reverse) {
+      // reversed: BLOCK from s, then BLOCK from e
+      join(s, e);
+      return s;
+    }
     join(e, s);
   }
   return e;
@@ -355,56 +455,48 @@ static Fragment *regex(PTree *tree, State *state)
 
 static Fragment *class(PTree *tree, State *state, bool is_negative)
 {
-  size_t nranges = 0;
   PTree *curr;
   Fragment *f;
 
-  for (curr = tree; curr->nt == CLASSnt; curr = curr->children[curr->nchildren-1]) {
-    nranges++;
-  }
-
   if (is_negative) {
     f = newfrag(NRange, state);
   } else {
     f = newfrag(Range, state);
   }
 
-  f->in.s = nranges;
-  f->in.x = calloc(nranges*2, sizeof(char));
-  char *block = (char*)f->in.x;
+  // Lower the list of ranges to a bitmap.
+  unsigned char *set = newcharset();
+  f->in.x = (instr *) set;
 
   curr = tree;
-  nranges = 0;
   while (curr->nt == CLASSnt) {
     if (curr->production == 1 || curr->production == 2) {
       // Range
-      block[2*nranges] = curr->children[0]->tok.c;
-      block[2*nranges+1] = curr->children[1]->tok.c;
+      charset_add(set, curr->children[0]->tok.c, curr->children[1]->tok.c);
     } else {
       // Single
-      block[2*nranges] = curr->children[0]->tok.c;
-      block[2*nranges+1] = curr->children[0]->tok.c;
+      charset_add(set, curr->children[0]->tok.c, curr->children[0]->tok.c);
     }
     curr = curr->children[curr->nchildren-1];
-    nranges++;
   }
 
   f->next = newfrag(Match, state);
   return f;
 }
 
-instr *codegen(PTree *tree, size_t *n)
-{
-  // Generate code.
-  State s = {0, 0};
-  Fragment *f = regex(tree, &s);
+/**
+   @brief Turn a fragment list into an array of code, and free the list.
 
+   The code is cleaned up by optimize() before it is returned.
+ */
+static instr *flatten(Fragment *f, State *s, size_t *n)
+{
   // Get the length of the code
   *n = fraglen(f);
 
   // Allocate buffers for the code, and for a lookup table of targets for jumps.
   instr *code = calloc(*n, sizeof(instr));
-  size_t *targets = calloc(s.id, sizeof(size_t));
+  size_t *targets = calloc(s->id, sizeof(size_t));
 
   // Fill up the lookup table.
   size_t i = 0;
@@ -426,5 +518,78 @@ instr *codegen(PTree *tree, size_t *n)
 
   free(targets);
   freefraglist(f);
-  return code;
+  return optimize(code, n);
+}
+
+instr *codegen(PTree *tree, size_t *n)
+{
+  // Generate code.
+  State s = {0, 0, false};
+  Fragment *f = regex(tree, &s);
+  return flatten(f, &s, n);
+}
+
+/**
+   @brief Generate code which matches the reverse of what a parse tree matches.
+
+   Concatenations are generated in the opposite order, so the code can be run
+   backwards over a string, starting from where a match ends.  Parentheses don't
+   generate Save instructions.
+ */
+instr *codegen_reverse(PTree *tree, size_t *n)
+{
+  State s = {0, 0, true};
+  Fragment *f = regex(tree, &s);
+  return flatten(f, &s, n);
+}
+
+/**
+   @brief Generate a single program which matches any of several parse trees.
+
+   The match instruction of each tree is labelled with its index in the array
+   (in the s field), so a matcher can tell which patterns matched.
+        split L1 S2
+    L1:
+        BLOCK from trees[0]  ;; ends with "match 0"
+    S2:
+        split L2 S3
+    L2:
+        BLOCK from trees[1]  ;; ends with "match 1"
+        ...
+    Ln:
+        BLOCK from trees[n-1]
+   Capture groups are numbered across all the trees, so no two patterns share
+   a slot.
+ */
+instr *codegen_set(PTree **trees, size_t ntrees, size_t *n)
+{
+  State s = {0, 0, false};
+  Fragment *head = NULL, *tail = NULL;
+
+  assert(ntrees > 0);
+  for (size_t i = 0; i < ntrees; i++) {
+    Fragment *f = regex(trees[i], &s);
+    for (Fragment *curr = f; curr; curr = curr->next) {
+      if (curr->in.code == Match) {
+        curr->in.s = i;
+      }
+    }
+
+    if (i + 1 < ntrees) {
+      // Try this pattern, then the rest.
+      Fragment *split = newfrag(Split, &s);
+      split->in.x = (instr*) f->id;
+      split->next = f;
+      f = split;
+    }
+    if (tail) {
+      tail->in.y = (instr*) f->id;
+      last(tail)->next = f;
+    } else {
+      head = f;
+    }
+    tail = f;
+  }
+
+  return flatten(head, &s, n);
 }
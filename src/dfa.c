@@ -0,0 +1,486 @@
+/***************************************************************************//**
+
+  @file         dfa.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Lazily constructed DFA, built from Pike VM bytecode.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on how the lazy DFA works:
+
+  When the Pike VM executes, the only thing that distinguishes one step from
+  another (captures aside) is the list of instructions its threads are waiting
+  at, in priority order.  So that list can serve as a DFA state: stepping every
+  thread in the list over a character gives the list for the next state.  This
+  is just the subset construction, except that the "subsets" are ordered, which
+  lets the DFA report the same match as the VM.  Everything after a Match in a
+  list is dropped, since the VM cuts those threads off.
+
+  Rather than building every state up front (which could take exponential
+  time), states are built the first time they are reached, and transitions are
+  remembered in each state, with one entry per byte class (see byteclasses() in
+  program.c) rather than per byte.  The number of states is bounded.  When the
+  cache fills up, it is thrown away and rebuilt from the current state.  If
+  that happens too often, the DFA gives up and the Pike VM is used instead.
+
+  Programs with assertions (see anchor.c) aren't handled, since which threads
+  survive an Assert depends on the bytes on either side of it, not just on the
+  state.  The DFA gives up on them straight away.
+
+*******************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+/*
+  Number of times the cache may be flushed during a single call, before we give
+  up and fall back to the Pike VM.
+ */
+#define DFA_MAXFLUSH 8
+
+/*
+  Initial number of hash buckets.  The table doubles whenever there are more
+  states than buckets, so it is never much bigger than the cache really is.
+ */
+#define DFA_MINTABLE 64
+
+struct dstate {
+  size_t id;          // order in which states were created since the last flush
+  size_t *insts;      // instruction indices, in priority order
+  size_t n;           // number of instructions
+  bool inject;        // start a new thread after each step (for search)
+  bool match;         // whether the last instruction is a Match
+  dstate *hnext;      // next state in the same hash bucket
+  dstate *next[];     // transitions by byte class, NULL when not yet computed
+};
+
+struct dfa {
+  const program *p;
+  scratch *s;         // for falling back to the Pike VM
+  size_t maxstates;
+  size_t nstates;
+  dstate **table;     // hash table of states
+  size_t ntable;
+  dstate *start[2];   // start states (anchored, unanchored)
+
+  // Working space for computing transitions.
+  sparse_set visited;
+  instr **stack;
+  size_t *buf;
+  size_t nbuf;
+};
+
+/**
+   @brief Create a lazy DFA for a program.
+
+   Like a scratch, a DFA holds state which is modified while matching, so it
+   may only be used by one thread at a time.  The program is not copied, so it
+   must outlive the DFA.
+   @param p Program to match.
+   @param maxstates Maximum number of states to keep in the cache (SIZE_MAX for
+   no limit).  Memory is only allocated for the states actually created.
+ */
+dfa *newdfa(const program *p, size_t maxstates)
+{
+  dfa *d = calloc(1, sizeof(dfa));
+  d->p = p;
+  d->s = newscratch(p);
+  d->maxstates = maxstates < DFA_MINSTATES ? DFA_MINSTATES : maxstates;
+  d->ntable = DFA_MINTABLE;
+  d->table = calloc(d->ntable, sizeof(dstate *));
+  ss_init(&d->visited, p->n);
+  d->stack = calloc(p->n + 1, sizeof(instr *));
+  d->buf = calloc(p->n, sizeof(size_t));
+  return d;
+}
+
+/**
+   @brief Throw away every state in the cache.
+ */
+static void flush(dfa *d)
+{
+  for (size_t i = 0; i < d->ntable; i++) {
+    dstate *st = d->table[i];
+    while (st) {
+      dstate *next = st->hnext;
+      free(st->insts);
+      free(st);
+      st = next;
+    }
+    d->table[i] = NULL;
+  }
+  d->start[0] = NULL;
+  d->start[1] = NULL;
+  d->nstates = 0;
+}
+
+void free_dfa(dfa *d)
+{
+  flush(d);
+  free(d->table);
+  ss_free(&d->visited);
+  free(d->stack);
+  free(d->buf);
+  free_scratch(d->s);
+  free(d);
+}
+
+static size_t hash(size_t *insts, size_t n, bool inject)
+{
+  // FNV-1a
+  uint64_t h = 14695981039346656037ULL ^ inject;
+  for (size_t i = 0; i < n; i++) {
+    h = (h ^ insts[i]) * 1099511628211ULL;
+  }
+  return (size_t) h;
+}
+
+/**
+   @brief Double the number of hash buckets, and rehash every state.
+ */
+static void grow(dfa *d)
+{
+  size_t ntable = d->ntable * 2;
+  dstate **table = calloc(ntable, sizeof(dstate *));
+  for (size_t i = 0; i < d->ntable; i++) {
+    dstate *st = d->table[i];
+    while (st) {
+      dstate *next = st->hnext;
+      size_t bucket = hash(st->insts, st->n, st->inject) & (ntable - 1);
+      st->hnext = table[bucket];
+      table[bucket] = st;
+      st = next;
+    }
+  }
+  free(d->table);
+  d->table = table;
+  d->ntable = ntable;
+}
+
+/**
+   @brief Return the state for an instruction list, creating it if necessary.
+
+   Anything after the first Match is dropped first.
+   @returns The state, or NULL if the cache is full.
+ */
+static dstate *lookup(dfa *d, size_t *insts, size_t n, bool inject)
+{
+  bool match = false;
+  for (size_t i = 0; i < n; i++) {
+    if (d->p->code[insts[i]].code == Match) {
+      n = i + 1;
+      match = true;
+      break;
+    }
+  }
+
+  size_t bucket = hash(insts, n, inject) & (d->ntable - 1);
+  for (dstate *st = d->table[bucket]; st; st = st->hnext) {
+    if (st->n == n && st->inject == inject &&
+        memcmp(st->insts, insts, n * sizeof(size_t)) == 0) {
+      return st;
+    }
+  }
+
+  if (d->nstates >= d->maxstates) {
+    return NULL;
+  }
+  if (d->nstates >= d->ntable) {
+    grow(d);
+    bucket = hash(insts, n, inject) & (d->ntable - 1);
+  }
+
+  dstate *st = calloc(1, sizeof(dstate) + d->p->nclass * sizeof(dstate *));
+  st->insts = calloc(n, sizeof(size_t));
+  memcpy(st->insts, insts, n * sizeof(size_t));
+  st->n = n;
+  st->inject = inject;
+  st->match = match;
+  st->id = d->nstates;
+  st->hnext = d->table[bucket];
+  d->table[bucket] = st;
+  d->nstates++;
+  return st;
+}
+
+/**
+   @brief Add the epsilon closure of an instruction to the working list.
+
+   This visits instructions in the same order as addthread() in pike.c, so that
+   the list comes out in the same priority order as a Pike VM thread list.
+ */
+static void closure(dfa *d, instr *pc)
+{
+  const program *p = d->p;
+  size_t nstack = 0;
+  d->stack[nstack++] = pc;
+
+  while (nstack > 0) {
+    pc = d->stack[--nstack];
+    while (pc != NULL) {
+      size_t idx = pc - p->code;
+      if (ss_contains(&d->visited, idx)) {
+        break;
+      }
+      ss_insert(&d->visited, idx);
+
+      switch (pc->code) {
+      case Jump:
+        pc = pc->x;
+        break;
+      case Split:
+        d->stack[nstack++] = pc->y;
+        pc = pc->x;
+        break;
+      case Save:
+        pc = pc + 1;
+        break;
+      default:
+        d->buf[d->nbuf++] = idx;
+        pc = NULL;
+        break;
+      }
+    }
+  }
+}
+
+/**
+   @brief Return the start state.
+   @param anchored Whether new threads are started only at the beginning.
+   @returns The start state, or NULL if the cache is full.
+ */
+static dstate *startstate(dfa *d, bool anchored)
+{
+  if (d->start[anchored] == NULL) {
+    d->nbuf = 0;
+    ss_clear(&d->visited);
+    closure(d, d->p->code);
+    d->start[anchored] = lookup(d, d->buf, d->nbuf, !anchored);
+  }
+  return d->start[anchored];
+}
+
+/**
+   @brief Compute the state reached from a state on a byte.
+   @returns The new state, or NULL if the cache is full.
+ */
+static dstate *step(dfa *d, dstate *st, unsigned char c)
+{
+  const program *p = d->p;
+  d->nbuf = 0;
+  ss_clear(&d->visited);
+
+  for (size_t i = 0; i < st->n; i++) {
+    instr *pc = p->code + st->insts[i];
+    if (pc->code == Match) {
+      break;
+    }
+    if (accepts(pc, c)) {
+      closure(d, pc + 1);
+    }
+  }
+
+  // Until something matches, a search starts a new thread at each index.
+  bool inject = st->inject && !st->match;
+  if (inject) {
+    closure(d, p->code);
+  }
+
+  return lookup(d, d->buf, d->nbuf, inject);
+}
+
+/*
+  The functions below let fulldfa.c enumerate states without ever flushing the
+  cache, so that state IDs stay stable.
+ */
+
+/**
+   @brief Return the start state, or NULL if the cache is full.
+ */
+dstate *dfa_start(dfa *d, bool anchored)
+{
+  return startstate(d, anchored);
+}
+
+/**
+   @brief Return the transition from a state, or NULL if the cache is full.
+ */
+dstate *dfa_next(dfa *d, dstate *st, unsigned char c)
+{
+  size_t k = d->p->classes[c];
+  if (st->next[k] == NULL) {
+    st->next[k] = step(d, st, c);
+  }
+  return st->next[k];
+}
+
+size_t dfa_stateid(const dstate *st)
+{
+  return st->id;
+}
+
+bool dfa_accepting(const dstate *st)
+{
+  return st->match;
+}
+
+/**
+   @brief Return whether no thread is left alive in a state.
+ */
+bool dfa_dead(const dstate *st)
+{
+  return st->n == 0;
+}
+
+/**
+   @brief Run the DFA over a buffer.
+   @param anchored Whether the match must begin at the start of input.
+   @param[out] gaveup Set to true if the cache thrashed too much to continue, or
+   if the program has assertions.
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+static ssize_t dfa_exec(dfa *d, const unsigned char *buf, size_t len,
+                        bool anchored, bool *gaveup)
+{
+  const unsigned char *classes = d->p->classes;
+  ssize_t match = -1;
+  size_t nflush = 0;
+  dstate *st;
+  size_t sp;
+
+  if (d->p->assertions) {
+    *gaveup = true;
+    return -1;
+  }
+  st = startstate(d, anchored);
+
+  if (st == NULL) {
+    // The cache was filled by an earlier call.
+    flush(d);
+    st = startstate(d, anchored);
+  }
+
+  *gaveup = false;
+  for (sp = 0; ; sp++) {
+    if (st->match) {
+      match = sp;
+    }
+    if (st->n == 0 || sp == len) {
+      break;
+    }
+
+    unsigned char c = buf[sp];
+    dstate *next = st->next[classes[c]];
+    if (next == NULL) {
+      next = step(d, st, c);
+      if (next == NULL) {
+        // The cache is full.  Flush it, and rebuild the current state.
+        if (++nflush > DFA_MAXFLUSH) {
+          *gaveup = true;
+          return -1;
+        }
+        memcpy(d->buf, st->insts, st->n * sizeof(size_t));
+        size_t n = st->n;
+        bool inject = st->inject;
+        flush(d);
+        st = lookup(d, d->buf, n, inject);
+        next = step(d, st, c);
+        assert(next != NULL);
+      }
+      st->next[classes[c]] = next;
+    }
+    st = next;
+  }
+
+  return match;
+}
+
+/**
+   @brief Match a program against the start of a buffer, using a lazy DFA.
+
+   The result is the same as run_bytes().  The DFA can't track captures, so
+   when they are requested and the input matches, the Pike VM is run to find
+   them.  The Pike VM is also used if the DFA cache thrashes.
+   @param d DFA created for the program by newdfa().
+   @param buf Bytes to match.
+   @param len Number of bytes in buf.
+   @param[out] saved Where to put the capture list (may be NULL).
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t dfa_run_bytes(dfa *d, const unsigned char *buf, size_t len,
+                      size_t **saved)
+{
+  bool gaveup;
+  ssize_t match = dfa_exec(d, buf, len, true, &gaveup);
+  if (gaveup || (saved && match != -1)) {
+    return run_bytes(d->p, d->s, buf, len, saved);
+  }
+  if (saved) {
+    *saved = NULL;
+  }
+  return match;
+}
+
+ssize_t dfa_run(dfa *d, char *input, size_t **saved)
+{
+  return dfa_run_bytes(d, (unsigned char *) input, strlen(input), saved);
+}
+
+/**
+   @brief Search for the leftmost match of a program, using a lazy DFA.
+
+   The result is the same as search_bytes().  The DFA alone only finds where
+   the match ends.  When the start is requested, the program's reversed code is
+   run backwards from the end to find it (see reverse.c).  When captures are
+   requested too, the Pike VM is then run over just the matched span.  Programs
+   without reversed code (from newprogram()) fall back to search_bytes().
+   @param d DFA created for the program by newdfa().
+   @param buf Bytes to search.
+   @param len Number of bytes in buf.
+   @param[out] start Where to put the start index of the match (may be NULL).
+   @param[out] saved Where to put the capture list (may be NULL).
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t dfa_search_bytes(dfa *d, const unsigned char *buf, size_t len,
+                         size_t *start, size_t **saved)
+{
+  bool gaveup;
+  ssize_t match = dfa_exec(d, buf, len, false, &gaveup);
+  if (gaveup || ((start || saved) && match != -1 && d->p->rev == NULL)) {
+    return search_bytes(d->p, d->s, buf, len, start, saved);
+  }
+  if (saved) {
+    *saved = NULL;
+  }
+  if (match == -1 || (start == NULL && saved == NULL)) {
+    return match;
+  }
+
+  // No match begins before the leftmost one, so the earliest index from which
+  // the regex matches up to the end is the start.
+  size_t from = reverse_scan(d->p->rev, d->s, buf, len, 0, match);
+  assert(from <= (size_t) match);
+  if (saved) {
+    return pike_window(d->p, d->s, buf, match, from, from, start, saved,
+                       NULL);
+  }
+  *start = from;
+  return match;
+}
+
+ssize_t dfa_search(dfa *d, char *input, size_t *start, size_t **saved)
+{
+  return dfa_search_bytes(d, (unsigned char *) input, strlen(input), start,
+                          saved);
+}
@@ -0,0 +1,405 @@
+/***************************************************************************//**
+
+  @file         fulldfa.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Ahead-of-time DFA compilation and minimization.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on full DFAs:
+
+  The lazy DFA (dfa.c) builds states as it needs them.  When the patterns are
+  fixed ahead of time, it can be better to build every state once, up front,
+  and end up with a plain transition table.  We reuse the lazy DFA to find the
+  states: starting at the start state, we follow every transition on every byte
+  until no new states turn up (or there are too many).
+
+  The resulting DFA usually has redundant states, so we minimize it with
+  Hopcroft's partition refinement algorithm.  We start with two blocks
+  (accepting and non-accepting states), and repeatedly split blocks whose
+  members disagree about which block some byte leads to.  When nothing more can
+  be split, each block becomes one state of the minimal DFA.
+
+  States are numbered so that accepting states come first, which means that
+  matching needs only one table load per byte (plus one to find the byte's
+  class, since the table has a column per byte class rather than per byte).
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+#define NONE ((size_t)-1)
+
+struct fulldfa {
+  unsigned char classes[256]; // byte class of each byte
+  size_t nclass;
+  uint32_t *trans;    // nstates x nclass transition table
+  size_t nstates;
+  size_t naccept;     // states [0, naccept) are accepting
+  size_t start;
+  size_t dead;        // state which can never accept again, or NONE
+};
+
+/**
+   @brief A partition of states into blocks, for Hopcroft's algorithm.
+
+   The states of each block are contiguous in elems, and a block's "marked"
+   states are moved to its front while deciding how to split it.
+ */
+typedef struct partition partition;
+struct partition {
+  size_t *elems;      // states, grouped by block
+  size_t *loc;        // index of each state in elems
+  size_t *block;      // block of each state
+  size_t *first;      // start of each block in elems
+  size_t *end;        // end of each block in elems
+  size_t *nmarked;    // number of marked states at the front of each block
+  bool *inwork;       // whether each block is on the worklist
+  size_t nblocks;
+};
+
+/**
+   @brief Enumerate every DFA state reachable from the start.
+   @param reps A representative byte of each class.
+   @param nclass Number of byte classes.
+   @param[out] states Array of states, indexed by ID (ID is discovery order).
+   @returns Number of states, or 0 if there are more than the cache holds.
+ */
+static size_t enumerate(dfa *d, bool anchored, const unsigned char *reps,
+                        size_t nclass, dstate **states)
+{
+  size_t nstates = 0;
+  dstate *st = dfa_start(d, anchored);
+  if (st == NULL) {
+    return 0;
+  }
+  states[nstates++] = st;
+
+  for (size_t k = 0; k < nstates; k++) {
+    for (size_t c = 0; c < nclass; c++) {
+      dstate *next = dfa_next(d, states[k], reps[c]);
+      if (next == NULL) {
+        return 0;
+      }
+      if (dfa_stateid(next) == nstates) {
+        states[nstates++] = next;
+      }
+    }
+  }
+  return nstates;
+}
+
+/**
+   @brief Move a state to the marked part at the front of its block.
+   @returns Whether this is the first state marked in its block.
+ */
+static bool mark(partition *P, size_t q)
+{
+  size_t b = P->block[q];
+  size_t i = P->loc[q];
+  size_t j = P->first[b] + P->nmarked[b];
+  if (i < j) {
+    return false; // already marked
+  }
+  size_t other = P->elems[j];
+  P->elems[j] = q;
+  P->loc[q] = j;
+  P->elems[i] = other;
+  P->loc[other] = i;
+  return P->nmarked[b]++ == 0;
+}
+
+/**
+   @brief Split the marked states of a block into a new block.
+   @returns The new block, or NONE if every state was marked.
+ */
+static size_t split(partition *P, size_t b)
+{
+  size_t nmarked = P->nmarked[b];
+  P->nmarked[b] = 0;
+  if (nmarked == P->end[b] - P->first[b]) {
+    return NONE;
+  }
+
+  size_t nb = P->nblocks++;
+  P->first[nb] = P->first[b];
+  P->end[nb] = P->first[b] + nmarked;
+  P->nmarked[nb] = 0;
+  P->first[b] += nmarked;
+  for (size_t i = P->first[nb]; i < P->end[nb]; i++) {
+    P->block[P->elems[i]] = nb;
+  }
+  return nb;
+}
+
+/**
+   @brief Minimize a DFA given as a transition table over n states.
+   @param trans n x k transition table.
+   @param accept Whether each state accepts.
+   @param k Number of byte classes.
+   @param[out] block Which block (minimal state) each state belongs to.
+   @returns Number of blocks.
+ */
+static size_t minimize(uint32_t *trans, bool *accept, size_t n, size_t k,
+                       size_t *block)
+{
+  partition P;
+  P.elems = calloc(n, sizeof(size_t));
+  P.loc = calloc(n, sizeof(size_t));
+  P.block = block;
+  P.first = calloc(n, sizeof(size_t));
+  P.end = calloc(n, sizeof(size_t));
+  P.nmarked = calloc(n, sizeof(size_t));
+  P.inwork = calloc(n, sizeof(bool));
+  P.nblocks = 0;
+
+  // Inverse transitions: for each (state, class), which states lead there.
+  // Stored as one array, with predecessors of (t, c) in pred[start[t*k+c]..]
+  size_t *predstart = calloc(n * k + 1, sizeof(size_t));
+  size_t *pred = calloc(n * k, sizeof(size_t));
+  for (size_t q = 0; q < n; q++) {
+    for (size_t c = 0; c < k; c++) {
+      predstart[trans[q * k + c] * k + c + 1]++;
+    }
+  }
+  for (size_t i = 0; i < n * k; i++) {
+    predstart[i + 1] += predstart[i];
+  }
+  size_t *fill = calloc(n * k, sizeof(size_t));
+  for (size_t q = 0; q < n; q++) {
+    for (size_t c = 0; c < k; c++) {
+      size_t key = trans[q * k + c] * k + c;
+      pred[predstart[key] + fill[key]++] = q;
+    }
+  }
+  free(fill);
+
+  // Initial partition: accepting and non-accepting states.
+  size_t nelems = 0;
+  for (int acc = 1; acc >= 0; acc--) {
+    size_t start = nelems;
+    for (size_t q = 0; q < n; q++) {
+      if (accept[q] == acc) {
+        P.elems[nelems] = q;
+        P.loc[q] = nelems++;
+        P.block[q] = P.nblocks;
+      }
+    }
+    if (nelems > start) {
+      P.first[P.nblocks] = start;
+      P.end[P.nblocks] = nelems;
+      P.nblocks++;
+    }
+  }
+
+  // The worklist holds blocks whose predecessors have yet to be split on.
+  size_t *work = calloc(n, sizeof(size_t));
+  size_t nwork = 0;
+  size_t *splitter = calloc(n, sizeof(size_t));
+  size_t *touched = calloc(n, sizeof(size_t));
+  for (size_t b = 0; b < P.nblocks; b++) {
+    work[nwork++] = b;
+    P.inwork[b] = true;
+  }
+
+  while (nwork > 0) {
+    size_t a = work[--nwork];
+    P.inwork[a] = false;
+
+    // Take a copy, since the block may be split while we use it.
+    size_t nsplitter = P.end[a] - P.first[a];
+    memcpy(splitter, P.elems + P.first[a], nsplitter * sizeof(size_t));
+
+    for (size_t c = 0; c < k; c++) {
+      size_t ntouched = 0;
+      for (size_t i = 0; i < nsplitter; i++) {
+        size_t key = splitter[i] * k + c;
+        for (size_t j = predstart[key]; j < predstart[key + 1]; j++) {
+          if (mark(&P, pred[j])) {
+            touched[ntouched++] = P.block[pred[j]];
+          }
+        }
+      }
+
+      for (size_t i = 0; i < ntouched; i++) {
+        size_t b = touched[i];
+        size_t nb = split(&P, b);
+        if (nb == NONE) {
+          continue;
+        }
+        if (P.inwork[b]) {
+          work[nwork++] = nb;
+          P.inwork[nb] = true;
+        } else {
+          // It's enough to split on the smaller half.
+          size_t smaller =
+            (P.end[nb] - P.first[nb] < P.end[b] - P.first[b]) ? nb : b;
+          work[nwork++] = smaller;
+          P.inwork[smaller] = true;
+        }
+      }
+    }
+  }
+
+  free(work);
+  free(splitter);
+  free(touched);
+  free(pred);
+  free(predstart);
+  free(P.elems);
+  free(P.loc);
+  free(P.first);
+  free(P.end);
+  free(P.nmarked);
+  free(P.inwork);
+  return P.nblocks;
+}
+
+/**
+   @brief Compile a program into a complete, minimal DFA.
+
+   The DFA reports the same match end as run() (when anchored) or search()
+   (when not).  Construction can take time and memory exponential in the size
+   of the program, so it gives up when more than maxstates states are needed.
+   @param p Program to compile.
+   @param anchored Whether matches must begin at the start of input.
+   @param maxstates Largest number of (unminimized) states to allow.
+   @returns The DFA, or NULL if it would have too many states (or if the
+   program has assertions, which a DFA can't handle).
+ */
+fulldfa *newfulldfa(const program *p, bool anchored, size_t maxstates)
+{
+  if (p->assertions) {
+    return NULL;
+  }
+
+  size_t k = p->nclass;
+  unsigned char reps[256];
+  for (int c = 255; c >= 0; c--) {
+    reps[p->classes[c]] = c;
+  }
+
+  // newdfa() raises the limit to its minimum, and enumerate() can fill it.
+  if (maxstates < DFA_MINSTATES) {
+    maxstates = DFA_MINSTATES;
+  }
+  dfa *d = newdfa(p, maxstates);
+  dstate **states = calloc(maxstates, sizeof(dstate *));
+  size_t n = enumerate(d, anchored, reps, k, states);
+  if (n == 0) {
+    free(states);
+    free_dfa(d);
+    return NULL;
+  }
+
+  // Flatten the lazy DFA into a table.
+  uint32_t *trans = calloc(n * k, sizeof(uint32_t));
+  bool *accept = calloc(n, sizeof(bool));
+  size_t dead = NONE;
+  for (size_t q = 0; q < n; q++) {
+    accept[q] = dfa_accepting(states[q]);
+    if (dfa_dead(states[q])) {
+      dead = q;
+    }
+    for (size_t c = 0; c < k; c++) {
+      trans[q * k + c] = dfa_stateid(dfa_next(d, states[q], reps[c]));
+    }
+  }
+  free(states);
+  free_dfa(d);
+
+  size_t *block = calloc(n, sizeof(size_t));
+  size_t nblocks = minimize(trans, accept, n, k, block);
+
+  // Number the blocks so that accepting ones come first, and build the table
+  // from one representative state of each block.
+  fulldfa *f = calloc(1, sizeof(fulldfa));
+  memcpy(f->classes, p->classes, sizeof(f->classes));
+  f->nclass = k;
+  size_t *id = calloc(nblocks, sizeof(size_t));
+  size_t *rep = calloc(nblocks, sizeof(size_t));
+  for (size_t b = 0; b < nblocks; b++) {
+    id[b] = NONE;
+  }
+  for (int acc = 1; acc >= 0; acc--) {
+    for (size_t q = 0; q < n; q++) {
+      if (accept[q] == acc && id[block[q]] == NONE) {
+        id[block[q]] = f->nstates++;
+        rep[id[block[q]]] = q;
+        f->naccept += acc;
+      }
+    }
+  }
+  f->trans = calloc(f->nstates * k, sizeof(uint32_t));
+  for (size_t s = 0; s < f->nstates; s++) {
+    for (size_t c = 0; c < k; c++) {
+      f->trans[s * k + c] = id[block[trans[rep[s] * k + c]]];
+    }
+  }
+  f->start = id[block[0]];
+  f->dead = (dead == NONE) ? NONE : id[block[dead]];
+
+  free(id);
+  free(rep);
+  free(block);
+  free(accept);
+  free(trans);
+  return f;
+}
+
+void free_fulldfa(fulldfa *f)
+{
+  free(f->trans);
+  free(f);
+}
+
+/**
+   @brief Return the number of states in a (minimized) full DFA.
+ */
+size_t fulldfa_nstates(const fulldfa *f)
+{
+  return f->nstates;
+}
+
+/**
+   @brief Match a buffer using a full DFA.
+
+   Since the DFA is never modified, it may be shared between threads.
+   @param f DFA from newfulldfa().
+   @param buf Bytes to match.
+   @param len Number of bytes in buf.
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t fulldfa_exec_bytes(const fulldfa *f, const unsigned char *buf,
+                           size_t len)
+{
+  ssize_t match = -1;
+  size_t st = f->start;
+
+  for (size_t sp = 0; ; sp++) {
+    if (st < f->naccept) {
+      match = sp;
+    }
+    if (sp == len || st == f->dead) {
+      break;
+    }
+    st = f->trans[st * f->nclass + f->classes[buf[sp]]];
+  }
+  return match;
+}
+
+ssize_t fulldfa_exec(const fulldfa *f, char *input)
+{
+  return fulldfa_exec_bytes(f, (unsigned char *) input, strlen(input));
+}
@@ -0,0 +1,234 @@
+/***************************************************************************//**
+
+  @file         inner.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Searching for a literal required in the middle of every match.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on inner literals:
+
+  A regex like "\w+@example\.com" has no literal prefix, so the prefilter can't
+  help much, but every match contains "@example.com".  When a regex is compiled,
+  we look at the concatenation at the top of its parse tree for the longest run
+  of plain characters which isn't part of the literal prefix.  That splits the
+  regex into a prefix P, the literal L, and the rest.
+
+  A search then looks for L with memchr() and memcmp().  At each hit, the code
+  for P is run backwards from the hit (see reverse.c), to find the earliest
+  index where P could begin.  The Pike VM is then run forwards from there,
+  starting threads only up to the hit.  If nothing matches, the search moves on
+  to the next hit, so the VM only ever sees the input near hits.
+
+  When the rest can keep running for a long way (as with ".*"), a failed window
+  may get past the next hit, and the next window would cover the same input
+  again, which makes the search quadratic.  So once that happens, the rest of
+  the input is searched with a single run of the VM instead.
+
+  This is only correct when P can never match across an occurrence of L, since
+  then any match starting before a hit (and after the previous one) must use
+  that hit.  We make sure of that by only using a literal whose first byte P
+  can never consume.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+struct inner {
+  prefilter *lit; // finds occurrences of the literal
+  pprog *rev;     // code for the part before the literal, reversed
+};
+
+/**
+   @brief Return whether an EXPR is a single plain character.
+ */
+static bool literal_expr(PTree *expr)
+{
+  PTree *term = expr->children[0];
+  if (expr->nchildren != 1 || term->production != 1) {
+    return false;
+  }
+  TSym sym = term->children[0]->tok.sym;
+  return sym == CharSym || sym == Minus;
+}
+
+/**
+   @brief Generate reversed code for the first n EXPRs of a concatenation.
+
+   This builds a temporary REGEX tree which shares the EXPR subtrees.
+ */
+static instr *reverse_prefix(PTree **exprs, size_t n, size_t *ninstr)
+{
+  PTree *regex = calloc(1, sizeof(PTree));
+  PTree **subs = calloc(n, sizeof(PTree *));
+
+  for (size_t i = 0; i < n; i++) {
+    subs[i] = calloc(1, sizeof(PTree));
+    subs[i]->nt = SUBnt;
+    subs[i]->production = 1;
+    subs[i]->nchildren = 1;
+    subs[i]->children[0] = exprs[i];
+  }
+  for (size_t i = 0; i + 1 < n; i++) {
+    subs[i]->nchildren = 2;
+    subs[i]->children[1] = subs[i + 1];
+  }
+  regex->nt = REGEXnt;
+  regex->production = 1;
+  regex->nchildren = 1;
+  regex->children[0] = subs[0];
+
+  instr *code = codegen_reverse(regex, ninstr);
+
+  for (size_t i = 0; i < n; i++) {
+    free(subs[i]);
+  }
+  free(subs);
+  free(regex);
+  return code;
+}
+
+/**
+   @brief Find a literal required in the middle of every match of a regex.
+   @param tree Parse tree of the regex.
+   @returns The literal, ready for inner_search(), or NULL if there is none.
+ */
+inner *inner_compile(PTree *tree)
+{
+  if (tree->nchildren != 1 || tree->children[0]->children[0] == NULL) {
+    return NULL; // alternation (or nothing) at the top
+  }
+
+  // Flatten the top level concatenation.
+  size_t nexpr = 0;
+  for (PTree *sub = tree->children[0]; sub != NULL;
+       sub = sub->nchildren == 2 ? sub->children[1] : NULL) {
+    nexpr++;
+  }
+  PTree **exprs = calloc(nexpr, sizeof(PTree *));
+  nexpr = 0;
+  for (PTree *sub = tree->children[0]; sub != NULL;
+       sub = sub->nchildren == 2 ? sub->children[1] : NULL) {
+    exprs[nexpr++] = sub->children[0];
+  }
+
+  // Find the longest run of characters which isn't part of the prefix (the
+  // prefilter already handles that).
+  size_t best = 0, nbest = 0, i = 0;
+  while (i < nexpr && literal_expr(exprs[i])) {
+    i++;
+  }
+  for (i = i > 0 ? i : 1; i < nexpr; i++) {
+    size_t n = 0;
+    while (i + n < nexpr && literal_expr(exprs[i + n])) {
+      n++;
+    }
+    if (n > nbest) {
+      best = i;
+      nbest = n;
+    }
+    i += n;
+  }
+  if (nbest == 0) {
+    free(exprs);
+    return NULL;
+  }
+
+  inner *in = calloc(1, sizeof(inner));
+  unsigned char *lit = calloc(nbest, sizeof(unsigned char));
+  for (size_t j = 0; j < nbest; j++) {
+    lit[j] = exprs[best + j]->children[0]->children[0]->tok.c;
+  }
+  size_t nrev;
+  instr *rev = reverse_prefix(exprs, best, &nrev);
+  free(exprs);
+
+  // The prefix must not be able to run over an occurrence of the literal.
+  for (size_t j = 0; j < nrev; j++) {
+    if (accepts(&rev[j], lit[0])) {
+      free(lit);
+      free_prog(rev, nrev);
+      free(in);
+      return NULL;
+    }
+  }
+
+  in->rev = pack(rev, nrev);
+  free_prog(rev, nrev);
+  in->lit = prefilter_literal(lit, nbest);
+  free(lit);
+  return in;
+}
+
+void free_inner(inner *in)
+{
+  if (in == NULL) {
+    return;
+  }
+  free_prefilter(in->lit);
+  free_pprog(in->rev);
+  free(in);
+}
+
+/**
+   @brief Return the length of the reversed code for the prefix.
+ */
+size_t inner_size(const inner *in)
+{
+  return in ? in->rev->n : 0;
+}
+
+/**
+   @brief Search for the leftmost match, using the program's inner literal.
+
+   This gives the same result as pikevm() (unanchored), but only runs the VM
+   near occurrences of the literal.
+   @param p Program with an inner literal.
+   @param s Scratch allocated for this program by newscratch().
+   @param buf Bytes to search.
+   @param len Number of bytes in buf.
+   @param[out] start Where to put the start of the match (may be NULL).
+   @param[out] saved Where to put the capture list (may be NULL).
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t inner_search(const program *p, scratch *s, const unsigned char *buf,
+                     size_t len, size_t *start, size_t **saved)
+{
+  const inner *in = p->inner;
+  size_t lo = 0;
+
+  size_t hit = prefilter_next(in->lit, buf, len, lo);
+  while (hit <= len) {
+    size_t from = reverse_scan(in->rev, s, buf, len, lo, hit);
+    size_t stop = hit;
+    if (from <= hit) {
+      ssize_t match = pike_window(p, s, buf, len, from, hit, start, saved,
+                                  &stop);
+      if (match != -1) {
+        return match;
+      }
+    }
+    lo = hit + 1;
+    hit = prefilter_next(in->lit, buf, len, lo);
+    if (hit <= len && stop > hit) {
+      // The VM got past the next hit, so windows would overlap from here on.
+      return pike_window(p, s, buf, len, lo, len, start, saved, NULL);
+    }
+  }
+
+  if (saved) {
+    *saved = NULL;
+  }
+  return -1;
+}
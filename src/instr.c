@@ -20,6 +20,7 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include "regex.h"
+#include "regparse.h"
 
 #define COMMENT ';'
 
@@ -33,7 +34,15 @@ enum linetype {
 typedef enum linetype linetype;
 
 char *Opcodes[] = {
-  "char", "match", "jump", "split", "save", "any", "range", "nrange"
+  "char", "match", "jump", "split", "save", "any", "range", "nrange", "string",
+  "assert"
+};
+
+/*
+  Names of the conditions of an Assert, by bit.
+ */
+static char *Assertions[] = {
+  "begin-text", "end-text", "begin-line", "end-line"
 };
 
 /*
@@ -43,19 +52,19 @@ char *char_to_string(char c)
 {
   #define CTS_BUFSIZE 5
   static char buffer[CTS_BUFSIZE];
-  if (c == ' ') {
-    buffer[0] = '\\';
-    buffer[1] = 'x';
-    buffer[2] = '2';
-    buffer[3] = '0';
-    buffer[4] = '\0'; // space = 0x20
-  } else if (isspace(c)) {
+  unsigned char u = (unsigned char) c;
+  if (u == ' ' || u == '\0' || u == ':' || u == COMMENT ||
+      (!isprint(u) && !isspace(u))) {
+    // space, NUL, any other unprintable byte, and bytes which would look like a
+    // label or a comment are written as \xHH
+    snprintf(buffer, CTS_BUFSIZE, "\\x%02x", u);
+  } else if (isspace(u)) {
     switch (c) {
     case '\n':
       buffer[1] = 'n';
       break;
     case '\f':
-      buffer[1] = 'n';
+      buffer[1] = 'f';
       break;
     case '\r':
       buffer[1]= 'r';
@@ -69,8 +78,6 @@ char *char_to_string(char c)
     }
     buffer[0] = '\\';
     buffer[2] = '\0';
-  } else if (c == '\0') {
-    buffer[0] = '\0'; // empty string...
   } else {
     buffer[0] = c;
     buffer[1] = '\0';
@@ -85,7 +92,7 @@ void fprintc(FILE *f, char c)
 
 char string_to_char(char *s) {
   unsigned int c;
-  if (s[0] == '\\') {
+  if (s[0] == '\\' && s[1] != '\0') {
     switch (s[1]) {
     case 'n':
       return '\n';
@@ -188,13 +195,17 @@ static instr read_instr(char *line, int lineno)
       exit(1);
     }
     inst.code = Char;
-    inst.c = tokens[1][0];
+    inst.c = string_to_char(tokens[1]);
   } else if (strcmp(tokens[0], Opcodes[Match]) == 0) {
-    if (ntok != 1) {
-      fprintf(stderr, "line %d: require 1 token for match\n", lineno);
+    if (ntok != 1 && ntok != 2) {
+      fprintf(stderr, "line %d: require 1 or 2 tokens for match\n", lineno);
       exit(1);
     }
     inst.code = Match;
+    if (ntok == 2) {
+      // which regex of a set matched
+      sscanf(tokens[1], "%zu", &inst.s);
+    }
   } else if (strcmp(tokens[0], Opcodes[Jump]) == 0) {
     if (ntok != 2) {
       fprintf(stderr, "line %d: require 2 tokens for jump\n", lineno);
@@ -231,18 +242,68 @@ static instr read_instr(char *line, int lineno)
       exit(1);
     }
     inst.code = (strcmp(tokens[0], Opcodes[Range]) == 0) ? Range : NRange;
-    inst.s = (size_t) (ntok - 1) / 2;
-    char *block = calloc(ntok - 1, sizeof(char));
-    inst.x = (instr*)block;
-    for (size_t i = 0; i < ntok - 1; i++) {
-      block[i] = string_to_char(tokens[i+1]);
+    unsigned char *set = newcharset();
+    inst.x = (instr*)set;
+    for (size_t i = 1; i + 1 < ntok; i += 2) {
+      charset_add(set, string_to_char(tokens[i]), string_to_char(tokens[i+1]));
+    }
+  } else if (strcmp(tokens[0], Opcodes[String]) == 0) {
+    if (ntok < 2) {
+      fprintf(stderr, "line %d: require at least 2 tokens for string\n",
+              lineno);
+      exit(1);
+    }
+    inst.code = String;
+    inst.s = ntok - 1;
+    char *bytes = calloc(inst.s, sizeof(char));
+    for (size_t i = 1; i < ntok; i++) {
+      bytes[i - 1] = string_to_char(tokens[i]);
+    }
+    inst.c = bytes[0];
+    inst.x = (instr*)bytes;
+  } else if (strcmp(tokens[0], Opcodes[Assert]) == 0) {
+    if (ntok != 2) {
+      fprintf(stderr, "line %d: require 2 tokens for assert\n", lineno);
+      exit(1);
+    }
+    inst.code = Assert;
+    for (size_t i = 0; i < nelem(Assertions); i++) {
+      if (strcmp(tokens[1], Assertions[i]) == 0) {
+        inst.s = 1 << i;
+      }
+    }
+    if (inst.s == 0) {
+      fprintf(stderr, "line %d: unknown assertion \"%s\"\n", lineno,
+              tokens[1]);
+      exit(1);
     }
   } else {
     fprintf(stderr, "line %d: unknown opcode \"%s\"\n", lineno, tokens[0]);
   }
+  free(tokens); // the tokens themselves point into line
   return inst;
 }
 
+/**
+   @brief Return how many instructions a line of code reads as.
+
+   This is 1, except for a string, which has an instruction for each byte.
+ */
+static size_t codelen(const char *line)
+{
+  size_t len = strlen(Opcodes[String]);
+  if (strncmp(line, Opcodes[String], len) != 0 || !isspace(line[len])) {
+    return 1;
+  }
+  size_t n = 0;
+  for (size_t i = len; line[i]; i++) {
+    if (!isspace(line[i]) && isspace(line[i - 1])) {
+      n++;
+    }
+  }
+  return n > 0 ? n : 1;
+}
+
 /**
    @brief Return the instruction index corresponding to a label.
    @param labels Array of labels
@@ -305,7 +366,7 @@ instr *read_prog(char *str, size_t *ninstr)
       nlabels++;
     } else {
       types[i] = Code;
-      ncode++;
+      ncode += codelen(lines[i]);
     }
   }
 
@@ -322,7 +383,7 @@ instr *read_prog(char *str, size_t *ninstr)
       labelindices[labelidx] = codeidx + 1;
       labelidx++;
     } else if (types[i] == Code) {
-      codeidx++;
+      codeidx += codelen(lines[i]);
     }
   }
   // we'll assume that the labels are valid for now
@@ -343,6 +404,14 @@ instr *read_prog(char *str, size_t *ninstr)
     if (rv[codeidx].code == Split) {
       rv[codeidx].y = rv + gettarget(labels, labelindices, nlabels, (char*)rv[codeidx].y, i+1);
     }
+    // a string is followed by a char for each byte after the first
+    if (rv[codeidx].code == String) {
+      for (size_t j = 1; j < rv[codeidx].s; j++) {
+        rv[codeidx + j].code = Char;
+        rv[codeidx + j].c = ((char *) rv[codeidx].x)[j];
+      }
+      codeidx += rv[codeidx].s - 1;
+    }
 
     codeidx++;
   }
@@ -373,12 +442,32 @@ instr *fread_prog(FILE *f, size_t *ninstr) {
       break;
     }
   }
+  buf[start] = '\0'; // there is always room, since the last read was short
 
   instr *rv = read_prog(buf, ninstr);
   free(buf);
   return rv;
 }
 
+/**
+   @brief Write a charset as a list of ranges, ending the line.
+ */
+static void write_charset(const unsigned char *set, FILE *f)
+{
+  for (int c = 0; c < 256; c++) {
+    if (!charset_has(set, c)) {
+      continue;
+    }
+    int lo = c;
+    while (c + 1 < 256 && charset_has(set, c + 1)) {
+      c++;
+    }
+    fprintf(f, " %s", char_to_string(lo));
+    fprintf(f, " %s", char_to_string(c));
+  }
+  fprintf(f, "\n");
+}
+
 /**
    @brief Write a program to a file.
  */
@@ -407,13 +496,16 @@ void write_prog(instr *prog, size_t n, FILE *f)
     if (labels[i] > 0) {
       fprintf(f, "L%zu:\n", labels[i]);
     }
-    char *block = (char*) prog[i].x;
     switch (prog[i].code) {
     case Char:
       fprintf(f, "    char %s\n", char_to_string(prog[i].c));
       break;
     case Match:
-      fprintf(f, "    match\n");
+      if (prog[i].s) {
+        fprintf(f, "    match %zu\n", prog[i].s);
+      } else {
+        fprintf(f, "    match\n");
+      }
       break;
     case Jump:
       fprintf(f, "    jump L%zu\n", labels[prog[i].x - prog]);
@@ -430,19 +522,27 @@ void write_prog(instr *prog, size_t n, FILE *f)
       break;
     case NRange:
       fprintf(f, "    nrange");
-      for (size_t j = 0; j < prog[i].s; j++) {
-        fprintf(f, " %s", char_to_string(block[2*j]));
-        fprintf(f, " %s", char_to_string(block[2*j + 1]));
-      }
-      fprintf(f, "\n");
+      write_charset((unsigned char *) prog[i].x, f);
       break;
     case Range:
       fprintf(f, "    range");
+      write_charset((unsigned char *) prog[i].x, f);
+      break;
+    case String:
+      // the chars after a string are implied by it
+      fprintf(f, "    string");
       for (size_t j = 0; j < prog[i].s; j++) {
-        fprintf(f, " %s", char_to_string(block[2*j]));
-        fprintf(f, " %s", char_to_string(block[2*j + 1]));
+        fprintf(f, " %s", char_to_string(((char *) prog[i].x)[j]));
       }
       fprintf(f, "\n");
+      i += prog[i].s - 1;
+      break;
+    case Assert:
+      for (size_t j = 0; j < nelem(Assertions); j++) {
+        if (prog[i].s == (size_t) 1 << j) {
+          fprintf(f, "    assert %s\n", Assertions[j]);
+        }
+      }
       break;
     }
   }
@@ -454,6 +554,8 @@ void free_prog(instr *prog, size_t n)
 {
   for (size_t i = 0; i < n; i++) {
     if (prog[i].code == Range || prog[i].code == NRange) {
+      free_charset((unsigned char *) prog[i].x);
+    } else if (prog[i].code == String) {
       free(prog[i].x);
     }
   }
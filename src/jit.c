@@ -0,0 +1,513 @@
+/***************************************************************************//**
+
+  @file         jit.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Compiling programs to x86-64 machine code.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on native code:
+
+  jit_compile() turns a program into x86-64 code for the bounded backtracker
+  (see backtrack.c), which reports the same matches as the Pike VM.  Each
+  instruction becomes a short run of machine code with its own label:
+
+  - First, the (instruction, string index) pair is checked and marked in the
+    visited bitmap with a single bts.  Since the program is fixed, the bit is
+    just sp * n + i, where n and i are constants in the code.
+  - Char, String, Any, Range and NRange compare the input directly, and branch
+    to the failure handler if it doesn't match.  A String compares its whole run
+    before moving on.
+  - Jump is a jmp.  Split pushes the address of its second target (and the
+    string index) on the backtracking stack, and goes on to the first.
+  - Save pushes the address of a small stub which restores the slot's old value,
+    and then sets the slot.
+  - Assert checks the bytes around the string index in place.
+  - Match returns the string index.
+
+  The failure handler pops the top of the stack into the string index register,
+  and jumps to the address it holds, so resuming a thread and restoring a
+  capture are the same operation.  The bottom of the stack is a "thread" which
+  returns -1.  All of the state lives in registers which the calling convention
+  lets us clobber, so the code needs no prologue beyond moving its arguments.
+
+  The machine code is written into an anonymous mapping, which is made
+  executable (and no longer writable) once it is complete.  On other
+  architectures, or if the mapping can't be made, jit_compile() returns false,
+  and the program is run by the interpreters as usual.
+
+*******************************************************************************/
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define _DEFAULT_SOURCE // for MAP_ANONYMOUS
+#define JIT_X86_64
+#endif
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+#include "regex.h"
+#include "regparse.h"
+
+/*
+  Largest bitmap (in bits) native code may use, which is also the most memory a
+  scratch holds for it: 4MiB.  Inputs that need more go to the Pike VM.
+ */
+#ifndef JIT_BUDGET
+#define JIT_BUDGET (32 * 1024 * 1024)
+#endif
+
+/*
+  Backtracking stack entry, as pushed by native code: the address to resume at,
+  and the value to put in the string index register first (for a capture
+  restoring stub, the slot's old value).
+ */
+typedef struct jitjob jitjob;
+struct jitjob {
+  void *target;
+  uint64_t value;
+};
+
+typedef ssize_t (*jitfn)(const unsigned char *buf, size_t len, size_t sp,
+                         uint64_t *visited, jitjob *stack, uint32_t *caps,
+                         jitjob *limit);
+
+struct jitcode {
+  void *mem;      // executable mapping
+  size_t size;    // size of the mapping
+  jitfn fn;       // entry point
+};
+
+struct jitstate {
+  uint64_t *visited;  // one bit per (string index, instruction)
+  size_t avisited;    // allocated words (64-bit, since bts accesses qwords)
+  jitjob *stack;
+  size_t astack;      // allocated entries
+};
+
+/**
+   @brief Return whether native backtracking fits in the budget for this input.
+ */
+bool jit_fits(size_t proglen, size_t len)
+{
+  return (len + 1) <= JIT_BUDGET / (proglen ? proglen : 1);
+}
+
+void free_jit(jitcode *j)
+{
+  if (j == NULL) {
+    return;
+  }
+#ifdef JIT_X86_64
+  munmap(j->mem, j->size);
+#endif
+  free(j);
+}
+
+void free_jitstate(jitstate *js)
+{
+  if (js == NULL) {
+    return;
+  }
+  free(js->visited);
+  free(js->stack);
+  free(js);
+}
+
+#ifdef JIT_X86_64
+
+/*
+  Registers, while the code runs:
+    rdi  buf          rsi  len          rdx  sp (string index)
+    r8   visited      r9   stack top    r10  stack limit
+    r11  caps         rax, rcx  scratch
+  Condition codes for jcc:
+ */
+#define JB  0x82
+#define JAE 0x83
+#define JE  0x84
+#define JNE 0x85
+#define JA  0x87
+
+typedef struct fixup fixup;
+struct fixup {
+  size_t at;    // offset of a rel32 field
+  size_t label; // label it refers to
+};
+
+/*
+  Buffer for machine code, with labels.  Label i < n is instruction i.  The
+  others are below, and then the restoring stub for each Save instruction.
+ */
+typedef struct emitter emitter;
+struct emitter {
+  unsigned char *code;
+  size_t n, alloc;
+  size_t *labels;
+  fixup *fixups;
+  size_t nfixups, afixups;
+};
+
+#define LFAIL(n) (n)
+#define LNOMATCH(n) ((n) + 1)
+#define LOVERFLOW(n) ((n) + 2)
+#define LRESTORE(n, i) ((n) + 3 + (i))
+
+static void emit(emitter *e, const unsigned char *bytes, size_t n)
+{
+  while (e->n + n > e->alloc) {
+    e->alloc *= 2;
+    e->code = realloc(e->code, e->alloc);
+  }
+  memcpy(e->code + e->n, bytes, n);
+  e->n += n;
+}
+
+#define EMIT(e, ...) do {                               \
+    const unsigned char bytes_[] = {__VA_ARGS__};       \
+    emit(e, bytes_, sizeof(bytes_));                    \
+  } while (0)
+
+static void imm32(emitter *e, uint32_t v)
+{
+  EMIT(e, v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, (v >> 24) & 0xff);
+}
+
+static void imm64(emitter *e, uint64_t v)
+{
+  imm32(e, v & 0xffffffff);
+  imm32(e, v >> 32);
+}
+
+/**
+   @brief Emit a 32-bit offset to a label, relative to the end of the field.
+ */
+static void rel32(emitter *e, size_t label)
+{
+  if (e->nfixups >= e->afixups) {
+    e->afixups *= 2;
+    e->fixups = realloc(e->fixups, e->afixups * sizeof(fixup));
+  }
+  e->fixups[e->nfixups++] = (fixup){e->n, label};
+  imm32(e, 0);
+}
+
+static void jmp(emitter *e, size_t label)
+{
+  EMIT(e, 0xe9);
+  rel32(e, label);
+}
+
+static void jcc(emitter *e, unsigned char cc, size_t label)
+{
+  EMIT(e, 0x0f, cc);
+  rel32(e, label);
+}
+
+/**
+   @brief Emit a push of a label's address onto the backtracking stack.
+
+   The value is left for the caller to fill in.
+ */
+static void push(emitter *e, size_t n, size_t label)
+{
+  EMIT(e, 0x4d, 0x39, 0xd1);        // cmp r9, r10
+  jcc(e, JAE, LOVERFLOW(n));
+  EMIT(e, 0x48, 0x8d, 0x05);        // lea rax, [rip + label]
+  rel32(e, label);
+  EMIT(e, 0x49, 0x89, 0x01);        // mov [r9], rax
+}
+
+/**
+   @brief Emit a check that there is a byte left at sp.
+ */
+static void more(emitter *e, size_t n)
+{
+  EMIT(e, 0x48, 0x39, 0xf2);        // cmp rdx, rsi
+  jcc(e, JAE, LFAIL(n));
+}
+
+/**
+   @brief Emit the code for one instruction.
+ */
+static void instruction(emitter *e, const pprog *pp, size_t i)
+{
+  const pinstr *pc = &pp->code[i];
+  size_t n = pp->n;
+
+  // Mark (sp, i) visited, and fail if it already was.
+  EMIT(e, 0x48, 0x69, 0xc2);        // imul rax, rdx, n
+  imm32(e, n);
+  EMIT(e, 0x48, 0x05);              // add rax, i
+  imm32(e, i);
+  EMIT(e, 0x49, 0x0f, 0xab, 0x00);  // bts [r8], rax (on the qword holding it)
+  jcc(e, JB, LFAIL(n));
+
+  switch (pc->op) {
+  case Char:
+    more(e, n);
+    EMIT(e, 0x80, 0x3c, 0x17, pc->x); // cmp byte [rdi + rdx], c
+    jcc(e, JNE, LFAIL(n));
+    EMIT(e, 0x48, 0xff, 0xc2);      // inc rdx
+    break;
+  case String:
+    // Check the whole run, and skip the Chars after it.
+    EMIT(e, 0x48, 0x8d, 0x82);      // lea rax, [rdx + len]
+    imm32(e, pc->y + 1);
+    EMIT(e, 0x48, 0x39, 0xf0);      // cmp rax, rsi
+    jcc(e, JA, LFAIL(n));
+    for (int32_t j = 0; j <= pc->y; j++) {
+      EMIT(e, 0x80, 0xbc, 0x17);    // cmp byte [rdi + rdx + j], c
+      imm32(e, j);
+      EMIT(e, pc[j].x);
+      jcc(e, JNE, LFAIL(n));
+    }
+    EMIT(e, 0x48, 0x81, 0xc2);      // add rdx, len
+    imm32(e, pc->y + 1);
+    jmp(e, i + pc->y + 1);
+    break;
+  case Any:
+    more(e, n);
+    EMIT(e, 0x48, 0xff, 0xc2);      // inc rdx
+    break;
+  case Range:
+  case NRange:
+    EMIT(e, 0x48, 0xb9);            // mov rcx, set
+    imm64(e, (uintptr_t) (pp->sets + pc->x * CHARSET_BYTES));
+    more(e, n);
+    EMIT(e, 0x0f, 0xb6, 0x04, 0x17); // movzx eax, byte [rdi + rdx]
+    EMIT(e, 0x48, 0x0f, 0xa3, 0x01); // bt [rcx], rax
+    jcc(e, pc->op == Range ? JAE : JB, LFAIL(n));
+    EMIT(e, 0x48, 0xff, 0xc2);      // inc rdx
+    break;
+  case Jump:
+    jmp(e, i + pc->x);
+    break;
+  case Split:
+    push(e, n, i + pc->y);
+    EMIT(e, 0x49, 0x89, 0x51, 0x08); // mov [r9 + 8], rdx
+    EMIT(e, 0x49, 0x83, 0xc1, 0x10); // add r9, 16
+    jmp(e, i + pc->x);
+    break;
+  case Save:
+    push(e, n, LRESTORE(n, i));
+    EMIT(e, 0x41, 0x8b, 0x83);      // mov eax, [r11 + 4 * slot]
+    imm32(e, 4 * pc->x);
+    EMIT(e, 0x49, 0x89, 0x41, 0x08); // mov [r9 + 8], rax
+    EMIT(e, 0x49, 0x83, 0xc1, 0x10); // add r9, 16
+    EMIT(e, 0x41, 0x89, 0x93);      // mov [r11 + 4 * slot], edx
+    imm32(e, 4 * pc->x);
+    break;
+  case Assert:
+    if (pc->x == BeginText) {
+      EMIT(e, 0x48, 0x85, 0xd2);    // test rdx, rdx
+      jcc(e, JNE, LFAIL(n));
+    } else if (pc->x == EndText) {
+      EMIT(e, 0x48, 0x39, 0xf2);    // cmp rdx, rsi
+      jcc(e, JNE, LFAIL(n));
+    } else if (pc->x == BeginLine) {
+      EMIT(e, 0x48, 0x85, 0xd2);    // test rdx, rdx
+      EMIT(e, 0x74, 0x0b);          // je past the next two instructions
+      EMIT(e, 0x80, 0x7c, 0x17, 0xff, '\n'); // cmp byte [rdi + rdx - 1], '\n'
+      jcc(e, JNE, LFAIL(n));
+    } else {
+      EMIT(e, 0x48, 0x39, 0xf2);    // cmp rdx, rsi
+      EMIT(e, 0x74, 0x0a);          // je past the next two instructions
+      EMIT(e, 0x80, 0x3c, 0x17, '\n'); // cmp byte [rdi + rdx], '\n'
+      jcc(e, JNE, LFAIL(n));
+    }
+    break;
+  case Match:
+    EMIT(e, 0x48, 0x89, 0xd0);      // mov rax, rdx
+    EMIT(e, 0xc3);                  // ret
+    break;
+  }
+}
+
+/**
+   @brief Generate machine code for a program.
+   @param[out] size Where to put the size of the code.
+   @returns The code (malloc'd).
+ */
+static unsigned char *generate(const pprog *pp, size_t *size)
+{
+  size_t n = pp->n;
+  emitter e = {0};
+  e.alloc = 64 * (n + 1);
+  e.code = calloc(e.alloc, 1);
+  e.labels = calloc(2 * n + 3, sizeof(size_t));
+  e.afixups = 4 * (n + 1);
+  e.fixups = calloc(e.afixups, sizeof(fixup));
+
+  // Move the arguments into place, and push the thread which fails.
+  EMIT(&e, 0x4d, 0x89, 0xcb);       // mov r11, r9 (caps)
+  EMIT(&e, 0x4d, 0x89, 0xc1);       // mov r9, r8 (stack)
+  EMIT(&e, 0x49, 0x89, 0xc8);       // mov r8, rcx (visited)
+  EMIT(&e, 0x4c, 0x8b, 0x54, 0x24, 0x08); // mov r10, [rsp + 8] (limit)
+  push(&e, n, LNOMATCH(n));
+  EMIT(&e, 0x49, 0x83, 0xc1, 0x10); // add r9, 16
+
+  for (size_t i = 0; i < n; i++) {
+    e.labels[i] = e.n;
+    instruction(&e, pp, i);
+  }
+
+  // Resume the thread (or restore the capture) on top of the stack.
+  e.labels[LFAIL(n)] = e.n;
+  EMIT(&e, 0x49, 0x83, 0xe9, 0x10); // sub r9, 16
+  EMIT(&e, 0x49, 0x8b, 0x51, 0x08); // mov rdx, [r9 + 8]
+  EMIT(&e, 0x41, 0xff, 0x21);       // jmp [r9]
+
+  e.labels[LNOMATCH(n)] = e.n;
+  EMIT(&e, 0x48, 0xc7, 0xc0, 0xff, 0xff, 0xff, 0xff); // mov rax, -1
+  EMIT(&e, 0xc3);                   // ret
+
+  e.labels[LOVERFLOW(n)] = e.n;
+  EMIT(&e, 0x48, 0xc7, 0xc0, 0xfe, 0xff, 0xff, 0xff); // mov rax, -2
+  EMIT(&e, 0xc3);                   // ret
+
+  for (size_t i = 0; i < n; i++) {
+    if (pp->code[i].op == Save) {
+      e.labels[LRESTORE(n, i)] = e.n;
+      EMIT(&e, 0x41, 0x89, 0x93);   // mov [r11 + 4 * slot], edx
+      imm32(&e, 4 * pp->code[i].x);
+      jmp(&e, LFAIL(n));
+    }
+  }
+
+  for (size_t i = 0; i < e.nfixups; i++) {
+    size_t at = e.fixups[i].at;
+    uint32_t rel = e.labels[e.fixups[i].label] - (at + 4);
+    for (int b = 0; b < 4; b++) {
+      e.code[at + b] = (rel >> (8 * b)) & 0xff;
+    }
+  }
+
+  free(e.labels);
+  free(e.fixups);
+  *size = e.n;
+  return e.code;
+}
+
+#endif // JIT_X86_64
+
+/**
+   @brief Compile a program to native code.
+
+   Afterwards, run() and search() (and the functions built on them) use the
+   native code for inputs up to a few megabytes, and the interpreters for
+   anything longer.  Results are the same either way.
+
+   This sets p->jit, so it must be called before the program is shared between
+   threads.  While matching, each scratch then holds a visited bitmap of one bit
+   per instruction per input byte, sized for the current input, which is at most
+   JIT_BUDGET bits (4MiB).
+   @param p Program to compile (from compile() or newprogram()).
+   @returns Whether native code was generated.  It isn't on architectures other
+   than x86-64, or when executable memory can't be mapped.
+ */
+bool jit_compile(program *p)
+{
+#ifdef JIT_X86_64
+  if (p->jit) {
+    return true;
+  }
+
+  size_t size;
+  unsigned char *code = generate(p->vm, &size);
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    free(code);
+    return false;
+  }
+  memcpy(mem, code, size);
+  free(code);
+  if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mem, size);
+    return false;
+  }
+
+  p->jit = calloc(1, sizeof(jitcode));
+  p->jit->mem = mem;
+  p->jit->size = size;
+  // ISO C has no conversion from an object pointer to a function pointer.
+  memcpy(&p->jit->fn, &mem, sizeof(jitfn));
+  return true;
+#else
+  (void) p;
+  return false;
+#endif
+}
+
+/**
+   @brief Match a program by backtracking, with its native code.
+
+   This is backtrack(), except that captures go straight to s->matched, and the
+   working memory is kept in the scratch.  The caller must check that the input
+   fits with jit_fits() first.
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t jit_exec(const program *p, scratch *s, const unsigned char *buf,
+                 size_t len, bool anchored)
+{
+  jitstate *js = s->js;
+  if (js == NULL) {
+    js = s->js = calloc(1, sizeof(jitstate));
+    js->astack = 64;
+    js->stack = calloc(js->astack, sizeof(jitjob));
+  }
+
+  // Size the bitmap for this input, so that one long input doesn't leave the
+  // scratch holding megabytes for every short one after it.
+  size_t nwords = (p->n * (len + 1) + 63) / 64;
+  if (nwords > js->avisited || nwords < js->avisited / 4) {
+    free(js->visited);
+    js->visited = calloc(nwords, sizeof(uint64_t));
+    js->avisited = nwords;
+  } else {
+    memset(js->visited, 0, nwords * sizeof(uint64_t));
+  }
+
+  const prefilter *pf = anchored ? NULL : p->prefilter;
+  for (size_t start = 0; start <= len; start++) {
+    if (!anchored) {
+      start = anchor_next(p, pf, buf, len, start);
+      if (start > len) {
+        break;
+      }
+    }
+    memset(s->matched, 0, s->nslot * sizeof(uint32_t));
+    s->matched[p->nsave] = start;
+    ssize_t match = p->jit->fn(buf, len, start, js->visited, js->stack,
+                               s->matched, js->stack + js->astack);
+    if (match == -2) {
+      // The stack is full.  Pairs visited on the way are not known to fail, so
+      // clear them, and try this start again with a bigger stack.
+      free(js->stack);
+      js->astack *= 2;
+      js->stack = calloc(js->astack, sizeof(jitjob));
+      memset(js->visited, 0, nwords * sizeof(uint64_t));
+      start--;
+      continue;
+    }
+    if (match != -1) {
+      return match;
+    }
+    if (anchored) {
+      break;
+    }
+  }
+  return -1;
+}
@@ -13,10 +13,96 @@
 
 *******************************************************************************/
 
+#include <ctype.h>
 #include <stdio.h>
 
 #include "regparse.h"
 
+/**
+   @brief Return the value of a hexadecimal digit, or -1 if it isn't one.
+ */
+static int hexval(char c)
+{
+  if (isdigit((unsigned char) c)) {
+    return c - '0';
+  } else if (isxdigit((unsigned char) c)) {
+    return tolower((unsigned char) c) - 'a' + 10;
+  }
+  return -1;
+}
+
+/**
+   @brief Read the bounds of a count ("{m}", "{m,}" or "{m,n}") at a '{'.
+
+   Bounds which are too large are clamped to REGEX_MAX_REPEAT + 1, so the parser
+   can report them.
+   @param i Index of the '{'.
+   @returns Index of the closing '}', or 0 if there is no count at i.
+ */
+static size_t count_at(const char *input, size_t i, unsigned bound[2])
+{
+  int nbound = 0;
+
+  bound[0] = bound[1] = 0;
+  i++;
+  while (nbound < 2 && isdigit((unsigned char) input[i])) {
+    while (isdigit((unsigned char) input[i])) {
+      bound[nbound] = bound[nbound] * 10 + (input[i++] - '0');
+      if (bound[nbound] > REGEX_MAX_REPEAT) {
+        bound[nbound] = REGEX_MAX_REPEAT + 1;
+      }
+    }
+    nbound++;
+    if (nbound == 1 && input[i] == ',') {
+      i++;
+      if (input[i] == '}') {
+        bound[1] = REPEAT_INF; // {m,}
+        nbound++;
+      }
+    } else if (nbound == 1) {
+      bound[1] = bound[0]; // {m}
+      nbound++;
+    }
+  }
+  if (nbound != 2 || input[i] != '}') {
+    return 0;
+  }
+  return i;
+}
+
+/**
+   @brief Lex a counted repetition at a '{'.
+
+   A count is only a repetition where one can apply: outside of a class, right
+   after something which ends a TERM, and not followed by another repetition
+   operator (other than the ? which makes it non-greedy).  Anywhere else, the
+   '{' is just a character, as it was before counts were supported.
+   @returns Whether there was one.
+ */
+static bool counted(Lexer *l)
+{
+  TSym prev = l->prev.sym;
+  unsigned bound[2], ignored[2];
+  size_t end;
+
+  if (l->inclass || l->index == 0 ||
+      !(prev == CharSym || prev == Special || prev == Dot || prev == Caret ||
+        prev == Dollar || prev == Minus || prev == RParen ||
+        prev == RBracket)) {
+    return false;
+  }
+  end = count_at(l->input, l->index, bound);
+  if (end == 0 || l->input[end + 1] == '*' || l->input[end + 1] == '+' ||
+      (l->input[end + 1] == '{' && count_at(l->input, end + 1, ignored))) {
+    return false;
+  }
+  l->tok = (Token){Counted, '{'};
+  l->min = bound[0];
+  l->max = bound[1];
+  l->index = end;
+  return true;
+}
+
 void escape(Lexer *l)
 {
   switch (l->input[l->index]) {
@@ -47,6 +133,9 @@ void escape(Lexer *l)
   case '^':
     l->tok = (Token){CharSym, '^'};
     break;
+  case '$':
+    l->tok = (Token){CharSym, '$'};
+    break;
   case 'n':
     l->tok = (Token){CharSym, '\n'};
     break;
@@ -56,6 +145,23 @@ void escape(Lexer *l)
   case '|':
     l->tok = (Token){CharSym, '|'};
     break;
+  case '{':
+    l->tok = (Token){CharSym, '{'};
+    break;
+  case '}':
+    l->tok = (Token){CharSym, '}'};
+    break;
+  case 'x':
+    // \xHH is the byte with hex value HH, so any byte (even NUL) can be used.
+    if (hexval(l->input[l->index + 1]) >= 0 &&
+        hexval(l->input[l->index + 2]) >= 0) {
+      l->tok = (Token){CharSym, (char) (hexval(l->input[l->index + 1]) * 16 +
+                                        hexval(l->input[l->index + 2]))};
+      l->index += 2;
+    } else {
+      l->tok = (Token){CharSym, 'x'};
+    }
+    break;
   default:
     l->tok = (Token){Special, l->input[l->index]};
     break;
@@ -90,9 +196,11 @@ Token nextsym(Lexer *l)
     break;
   case '[':
     l->tok = (Token){LBracket, '['};
+    l->inclass = true;
     break;
   case ']':
     l->tok = (Token){RBracket, ']'};
+    l->inclass = false;
     break;
   case '+':
     l->tok = (Token){Plus, '+'};
@@ -112,9 +220,17 @@ Token nextsym(Lexer *l)
   case '|':
     l->tok = (Token){Pipe, '|'};
     break;
+  case '$':
+    l->tok = (Token){Dollar, '$'};
+    break;
   case '.':
     l->tok = (Token){Dot, '.'};
     break;
+  case '{':
+    if (!counted(l)) {
+      l->tok = (Token){CharSym, '{'};
+    }
+    break;
   case '\\':
     l->index++;
     escape(l);
@@ -0,0 +1,299 @@
+/***************************************************************************//**
+
+  @file         onepass.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Deterministic matching for one-pass programs.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on one-pass programs:
+
+  A program is "one-pass" if, no matter what the input is, at most one Pike VM
+  thread survives each character.  For example, in "(\w+)=(\d+)", a thread in
+  the first loop either consumes another word character or an equals sign, and
+  never both.  For these programs, there is no need for thread lists, or for
+  copying captures between threads: we can just follow the one thread, and
+  update its captures in place.
+
+  To find out whether a program is one-pass, we take every place a thread can be
+  waiting between characters (the start of the program, and the instruction
+  after each consuming instruction), and follow its epsilon closure in priority
+  order, like addthread() does.  Each consuming instruction reached is an "arc",
+  labelled with the Save slots set on the way to it.  If two arcs from the same
+  place accept the same character, the program is not one-pass.  Arcs reached
+  after a Match are ignored, since the Pike VM cuts those threads off.
+
+  The arc for a String goes straight to the end of its run, and onepass_exec()
+  checks the rest of the run with memcmp().
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+#define NONE ((size_t)-1)
+
+typedef struct opnode opnode;
+struct opnode {
+  uint32_t *arc;      // 1 + index of the arc taken on each byte class, or 0
+  bool match;         // whether a Match is reachable before any lower arc
+  size_t mact, nmact; // Save slots set on the way to the Match
+};
+
+typedef struct oparc oparc;
+struct oparc {
+  size_t next;        // node reached after consuming
+  size_t act, nact;   // Save slots set on the way to the consuming instruction
+  const char *lit;    // for a String, the rest of its bytes
+  size_t nlit;
+};
+
+struct onepass {
+  size_t nsave;
+  unsigned char classes[256]; // byte class of each byte
+  size_t nclass;
+  uint32_t *table;    // nodes x nclass arc table (rows of opnode.arc)
+  opnode *nodes;
+  size_t nnodes;
+  oparc *arcs;
+  size_t narcs, aarcs;
+  size_t *actions;    // pool of Save slot lists, referred to by nodes and arcs
+  size_t nactions, aactions;
+};
+
+/*
+  Entry on the closure stack: an instruction to visit, and how many Save slots
+  were on the path to it.
+ */
+typedef struct opjob opjob;
+struct opjob {
+  instr *pc;
+  size_t depth;
+};
+
+void free_onepass(onepass *op)
+{
+  if (op == NULL) {
+    return;
+  }
+  free(op->table);
+  free(op->nodes);
+  free(op->arcs);
+  free(op->actions);
+  free(op);
+}
+
+/**
+   @brief Copy a list of Save slots into the action pool.
+   @returns Offset of the list in the pool.
+ */
+static size_t addactions(onepass *op, size_t *slots, size_t n)
+{
+  if (op->nactions + n > op->aactions) {
+    while (op->nactions + n > op->aactions) {
+      op->aactions *= 2;
+    }
+    op->actions = realloc(op->actions, op->aactions * sizeof(size_t));
+  }
+  memcpy(op->actions + op->nactions, slots, n * sizeof(size_t));
+  op->nactions += n;
+  return op->nactions - n;
+}
+
+/**
+   @brief Return the node for an instruction, creating it if necessary.
+ */
+static size_t getnode(onepass *op, size_t *nodeid, size_t *nodepc, size_t pc)
+{
+  if (nodeid[pc] == NONE) {
+    nodeid[pc] = op->nnodes;
+    nodepc[op->nnodes] = pc;
+    op->nnodes++;
+  }
+  return nodeid[pc];
+}
+
+/**
+   @brief Analyze a program, and build tables for it if it is one-pass.
+   @returns The tables, or NULL if the program is not one-pass.
+ */
+onepass *onepass_compile(const program *p)
+{
+  if (p->assertions) {
+    // Whether an Assert holds depends on the bytes around it, and the tables
+    // only look at one byte at a time.
+    return NULL;
+  }
+
+  onepass *op = calloc(1, sizeof(onepass));
+  size_t *nodeid = calloc(p->n, sizeof(size_t));
+  size_t *nodepc = calloc(p->n, sizeof(size_t));
+  size_t *path = calloc(p->n, sizeof(size_t));
+  opjob *stack = calloc(p->n + 1, sizeof(opjob));
+  sparse_set visited;
+  bool ok = true;
+
+  ss_init(&visited, p->n);
+  for (size_t i = 0; i < p->n; i++) {
+    nodeid[i] = NONE;
+  }
+  op->nsave = p->nsave;
+  // There is at most one node for the start, and one per instruction after a
+  // consuming instruction.
+  op->nodes = calloc(p->n, sizeof(opnode));
+  memcpy(op->classes, p->classes, sizeof(op->classes));
+  op->nclass = p->nclass;
+  op->table = calloc(p->n * p->nclass, sizeof(uint32_t));
+  for (size_t i = 0; i < p->n; i++) {
+    op->nodes[i].arc = op->table + i * p->nclass;
+  }
+  op->aarcs = 16;
+  op->arcs = calloc(op->aarcs, sizeof(oparc));
+  op->aactions = 16;
+  op->actions = calloc(op->aactions, sizeof(size_t));
+
+  getnode(op, nodeid, nodepc, 0);
+  for (size_t k = 0; ok && k < op->nnodes; k++) {
+    size_t nstack = 0;
+    bool matched = false;
+    ss_clear(&visited);
+    stack[nstack++] = (opjob){p->code + nodepc[k], 0};
+
+    while (ok && !matched && nstack > 0) {
+      opjob j = stack[--nstack];
+      instr *pc = j.pc;
+      size_t depth = j.depth, len;
+      while (pc != NULL) {
+        size_t idx = pc - p->code;
+        if (ss_contains(&visited, idx)) {
+          break;
+        }
+        ss_insert(&visited, idx);
+
+        switch (pc->code) {
+        case Jump:
+          pc = pc->x;
+          break;
+        case Split:
+          stack[nstack++] = (opjob){pc->y, depth};
+          pc = pc->x;
+          break;
+        case Save:
+          path[depth++] = pc->s;
+          pc = pc + 1;
+          break;
+        case Match:
+          op->nodes[k].match = true;
+          op->nodes[k].mact = addactions(op, path, depth);
+          op->nodes[k].nmact = depth;
+          matched = true; // lower priority threads are cut off
+          pc = NULL;
+          break;
+        default:
+          // A String's arc takes the whole run, since nothing can happen in
+          // the middle of it.
+          len = pc->code == String ? pc->s : 1;
+          if (idx + len >= p->n) {
+            ok = false; // consuming instruction falls off the program
+            pc = NULL;
+            break;
+          }
+          if (op->narcs >= op->aarcs) {
+            op->aarcs *= 2;
+            op->arcs = realloc(op->arcs, op->aarcs * sizeof(oparc));
+          }
+          op->arcs[op->narcs].next = getnode(op, nodeid, nodepc, idx + len);
+          op->arcs[op->narcs].act = addactions(op, path, depth);
+          op->arcs[op->narcs].nact = depth;
+          op->arcs[op->narcs].lit = len > 1 ? (char *) pc->x + 1 : NULL;
+          op->arcs[op->narcs].nlit = len - 1;
+          op->narcs++;
+          for (int c = 0; c < 256; c++) {
+            uint32_t *arc = &op->nodes[k].arc[op->classes[c]];
+            if (!accepts(pc, c) || *arc == op->narcs) {
+              continue;
+            }
+            if (*arc != 0) {
+              ok = false; // two threads could consume this character
+              break;
+            }
+            *arc = op->narcs;
+          }
+          pc = NULL;
+          break;
+        }
+      }
+    }
+  }
+
+  ss_free(&visited);
+  free(nodeid);
+  free(nodepc);
+  free(path);
+  free(stack);
+  if (!ok) {
+    free_onepass(op);
+    return NULL;
+  }
+  return op;
+}
+
+/**
+   @brief Match a one-pass program against the start of the input.
+
+   This follows the single live thread through the tables, updating captures in
+   place, and taking a copy only when the thread reaches a Match.
+   @param op Tables from onepass_compile().
+   @param buf Bytes to match.
+   @param len Number of bytes in buf.
+   @param caps Working space for captures, with room for nsave slots.
+   @param matched Where to put the captures of the match (nsave slots).
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t onepass_exec(const onepass *op, const unsigned char *buf, size_t len,
+                     uint32_t *caps, uint32_t *matched)
+{
+  ssize_t match = -1;
+  size_t node = 0;
+
+  memset(caps, 0, op->nsave * sizeof(uint32_t));
+  for (size_t sp = 0; ; sp++) {
+    opnode *nd = &op->nodes[node];
+    if (nd->match) {
+      memcpy(matched, caps, op->nsave * sizeof(uint32_t));
+      for (size_t i = 0; i < nd->nmact; i++) {
+        matched[op->actions[nd->mact + i]] = sp;
+      }
+      match = sp;
+    }
+
+    if (sp == len || nd->arc[op->classes[buf[sp]]] == 0) {
+      break;
+    }
+    oparc *a = &op->arcs[nd->arc[op->classes[buf[sp]]] - 1];
+    for (size_t i = 0; i < a->nact; i++) {
+      caps[op->actions[a->act + i]] = sp;
+    }
+    if (a->nlit > 0) {
+      // Nothing can match in the middle of a String, so compare the rest.
+      if (sp + 1 + a->nlit > len ||
+          memcmp(buf + sp + 1, a->lit, a->nlit) != 0) {
+        break;
+      }
+      sp += a->nlit;
+    }
+    node = a->next;
+  }
+
+  return match;
+}
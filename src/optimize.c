@@ -0,0 +1,207 @@
+/***************************************************************************//**
+
+  @file         optimize.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Peephole optimization of generated code.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on optimization:
+
+  Code generation glues fragments together with join(), which leaves behind
+  some instructions that do nothing useful: jumps to jumps, splits that point
+  at jumps, and so on.  Each of them costs an extra step in addthread() for
+  every thread at every byte, so optimize() cleans up the flattened code:
+
+  - Jump threading: a Jump or Split whose target is a Jump is pointed at the
+    final target instead.
+  - A Split whose two targets are the same is just a Jump.
+  - A Save which is immediately followed by a Save to the same slot does
+    nothing, and neither does a Jump to the next instruction.
+  - Instructions which can't be reached from the start are removed, along with
+    the ones which do nothing, and the remaining code is moved together.
+  - Finally, each run of two or more Chars which nothing jumps into (except at
+    the first one) becomes a String, so that the engines which can compare a
+    whole run at once (the backtracker and the one-pass matcher) do so.
+
+  Jumps to a Match are left alone.  Copying the Match would be one step
+  shorter for the Pike VM, but the DFA would then see two different match
+  instructions, and build two states where it used to need one.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+/**
+   @brief Follow a chain of Jumps to the first instruction which isn't one.
+
+   A loop made only of Jumps is left alone (it can't match anything anyway).
+ */
+static instr *thread_jumps(instr *pc, size_t n)
+{
+  instr *target = pc;
+  for (size_t steps = 0; target->code == Jump && steps < n; steps++) {
+    target = target->x;
+  }
+  return target->code == Jump ? pc : target;
+}
+
+/**
+   @brief Return whether an instruction does nothing but move on to the next.
+ */
+static bool nop(const instr *code, size_t i, size_t n)
+{
+  const instr *pc = &code[i];
+  if (pc->code == Jump) {
+    return pc->x == pc + 1;
+  }
+  return pc->code == Save && i + 1 < n && pc[1].code == Save &&
+    pc[1].s == pc->s;
+}
+
+/**
+   @brief Mark each run of literal bytes with a String.
+ */
+static void strings(instr *code, size_t n)
+{
+  bool *target = calloc(n, sizeof(bool));
+  for (size_t i = 0; i < n; i++) {
+    if (code[i].code == Jump || code[i].code == Split) {
+      target[code[i].x - code] = true;
+    }
+    if (code[i].code == Split) {
+      target[code[i].y - code] = true;
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (code[i].code == String) {
+      i += code[i].s - 1;
+      continue;
+    }
+    size_t len = 1;
+    while (code[i].code == Char && i + len < n &&
+           code[i + len].code == Char && !target[i + len]) {
+      len++;
+    }
+    if (len > 1) {
+      char *bytes = calloc(len, sizeof(char));
+      for (size_t j = 0; j < len; j++) {
+        bytes[j] = code[i + j].c;
+      }
+      code[i].code = String;
+      code[i].s = len;
+      code[i].x = (instr *) bytes;
+      i += len - 1;
+    }
+  }
+  free(target);
+}
+
+/**
+   @brief Optimize code produced by code generation.
+   @param code Instructions to optimize (freed by this function).
+   @param n In: number of instructions.  Out: number after optimization.
+   @returns The new code.
+ */
+instr *optimize(instr *code, size_t *n)
+{
+  size_t len = *n;
+
+  // Thread jumps, and turn splits with a single target into jumps.
+  for (size_t i = 0; i < len; i++) {
+    instr *pc = &code[i];
+    if (pc->code == Jump || pc->code == Split) {
+      pc->x = thread_jumps(pc->x, len);
+    }
+    if (pc->code == Split) {
+      pc->y = thread_jumps(pc->y, len);
+      if (pc->x == pc->y) {
+        pc->code = Jump;
+        pc->y = NULL;
+      }
+    }
+  }
+
+  // Find the reachable instructions.
+  bool *reach = calloc(len, sizeof(bool));
+  size_t *stack = calloc(len + 1, sizeof(size_t));
+  size_t nstack = 0;
+  stack[nstack++] = 0;
+  while (nstack > 0) {
+    size_t i = stack[--nstack];
+    while (i < len && !reach[i]) {
+      reach[i] = true;
+      instr *pc = &code[i];
+      if (pc->code == Match) {
+        break;
+      } else if (pc->code == Jump) {
+        i = pc->x - code;
+      } else if (pc->code == Split) {
+        stack[nstack++] = pc->y - code;
+        i = pc->x - code;
+      } else {
+        i++;
+      }
+    }
+  }
+
+  // Number the instructions which are kept.  An instruction which is dropped
+  // because it does nothing takes the index of the one after it.
+  size_t *index = calloc(len + 1, sizeof(size_t));
+  size_t kept = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (reach[i] && !nop(code, i, len)) {
+      kept++;
+    }
+  }
+  index[len] = kept;
+  for (size_t i = len; i-- > 0;) {
+    if (reach[i] && !nop(code, i, len)) {
+      index[i] = --kept;
+    } else {
+      index[i] = index[i + 1];
+    }
+  }
+  kept = index[len];
+
+  // Move the code, and free what was dropped.
+  instr *out = calloc(kept, sizeof(instr));
+  for (size_t i = 0; i < len; i++) {
+    instr *pc = &code[i];
+    if (!reach[i] || nop(code, i, len)) {
+      if (pc->code == Range || pc->code == NRange) {
+        free_charset((unsigned char *) pc->x);
+      } else if (pc->code == String) {
+        free(pc->x);
+      }
+      continue;
+    }
+    instr *in = &out[index[i]];
+    *in = *pc;
+    if (in->code == Jump || in->code == Split) {
+      in->x = out + index[pc->x - code];
+    }
+    if (in->code == Split) {
+      in->y = out + index[pc->y - code];
+    }
+  }
+
+  free(reach);
+  free(stack);
+  free(index);
+  free(code);
+  strings(out, kept);
+  *n = kept;
+  return out;
+}
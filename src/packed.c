@@ -0,0 +1,144 @@
+/***************************************************************************//**
+
+  @file         packed.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Compact, relocatable encoding of programs for the Pike VM.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on packed code:
+
+  An instr is convenient to generate and analyze, but it is large (an enum, a
+  char, a size_t and two pointers), and its jump targets are absolute pointers.
+  So when a program is created, its code is also packed into 8-byte pinstrs,
+  which is what the Pike VM runs:
+
+  - op: the opcode, in 8 bits.
+  - y: the second target of a Split, in 24 bits, relative to the instruction.
+    For a String, and the Chars after it, the number of bytes left in the run,
+    so the VM can move a thread along the run without following a closure.
+  - x: everything else, in 32 bits.  For Jump and Split, the (first) target,
+    relative to the instruction.  For Char and String, the (first) byte.  For
+    Save and Match, the slot or regex index.  For Assert, its condition.  For
+    Range and NRange, an index into the charset table.
+
+  Charsets are stored out of line, in a table after the code (each distinct
+  charset only once).  Since nothing in packed code is a pointer, it can be
+  copied, written out, or mapped from a file, and used as is.
+
+*******************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+/**
+   @brief Pack code for the Pike VM.
+   @param code Instructions to pack (not modified).
+   @param n Number of instructions (less than 2^23).
+   @returns The packed code, to be freed with free_pprog().
+ */
+pprog *pack(const instr *code, size_t n)
+{
+  pprog *pp = calloc(1, sizeof(pprog));
+  unsigned char **sets = calloc(n, sizeof(unsigned char *));
+
+  // Relative targets of Split must fit in 24 bits.
+  assert(n < (1 << 23));
+  pp->code = calloc(n, sizeof(pinstr));
+  pp->n = n;
+
+  for (size_t i = 0; i < n; i++) {
+    const instr *in = &code[i];
+    pinstr *pc = &pp->code[i];
+    pc->op = in->code;
+    switch (in->code) {
+    case Char:
+      pc->x = (unsigned char) in->c;
+      break;
+    case String:
+      // The String and the Chars after it count down the rest of the run.
+      pc->x = (unsigned char) in->c;
+      for (size_t j = 0; j < in->s; j++) {
+        pp->code[i + j].y = in->s - 1 - j;
+      }
+      break;
+    case Save:
+    case Match:
+    case Assert:
+      pc->x = in->s;
+      break;
+    case Jump:
+      pc->x = in->x - &code[i];
+      break;
+    case Split:
+      pc->x = in->x - &code[i];
+      pc->y = in->y - &code[i];
+      break;
+    case Range:
+    case NRange:
+      // Find the charset in the table, or add it.
+      pc->x = 0;
+      while (pc->x < (int32_t) pp->nsets &&
+             memcmp(sets[pc->x], in->x, CHARSET_BYTES) != 0) {
+        pc->x++;
+      }
+      if (pc->x == (int32_t) pp->nsets) {
+        sets[pp->nsets++] = (unsigned char *) in->x;
+      }
+      break;
+    case Any:
+      break;
+    }
+  }
+
+  pp->sets = calloc(pp->nsets, CHARSET_BYTES);
+  for (size_t i = 0; i < pp->nsets; i++) {
+    memcpy(pp->sets + i * CHARSET_BYTES, sets[i], CHARSET_BYTES);
+  }
+  free(sets);
+  return pp;
+}
+
+void free_pprog(pprog *pp)
+{
+  if (pp == NULL) {
+    return;
+  }
+  free(pp->code);
+  free(pp->sets);
+  free(pp);
+}
+
+/**
+   @brief Return whether a packed consuming instruction accepts a byte.
+ */
+bool paccepts(const pprog *pp, const pinstr *pc, unsigned char c)
+{
+  const unsigned char *set;
+  switch (pc->op) {
+  case Char:
+  case String:
+    return c == pc->x;
+  case Any:
+    return true;
+  case Range:
+    set = pp->sets + pc->x * CHARSET_BYTES;
+    return set[c >> 3] & (1 << (c & 7));
+  case NRange:
+    set = pp->sets + pc->x * CHARSET_BYTES;
+    return !(set[c >> 3] & (1 << (c & 7)));
+  default:
+    return false;
+  }
+}
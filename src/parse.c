@@ -22,7 +22,8 @@
 
 char *names[] = {
   "CharSym", "Special", "Eof", "LParen", "RParen", "LBracket", "RBracket",
-  "Plus", "Minus", "Star", "Question", "Caret", "Pipe", "Dot"
+  "Plus", "Minus", "Star", "Question", "Caret", "Pipe", "Dot", "Counted",
+  "Dollar"
 };
 
 char *ntnames[] = {
@@ -118,7 +119,7 @@ void expect(TSym s, Lexer *l)
 PTree *TERM(Lexer *l)
 {
   if (accept(CharSym, l) || accept(Dot, l) || accept(Special, l) ||
-      accept(Caret, l) || accept(Minus, l)) {
+      accept(Caret, l) || accept(Dollar, l) || accept(Minus, l)) {
     PTree *result = nonterminal_tree(TERMnt, 1);
     result->children[0] = terminal_tree(l->prev);
     result->production = 1;
@@ -159,9 +160,26 @@ PTree *EXPR(Lexer *l)
 {
   PTree *result = nonterminal_tree(EXPRnt, 1);
   result->children[0] = TERM(l);
-  if (accept(Plus, l) || accept(Star, l) || accept(Question, l)) {
+  if (accept(Plus, l) || accept(Star, l) || accept(Question, l) ||
+      accept(Counted, l)) {
     result->nchildren++;
     result->children[1] = terminal_tree(l->prev);
+    if (l->prev.sym == Counted) {
+      PTree *count = result->children[1];
+      count->min = l->min;
+      count->max = l->max;
+      if (count->min > REGEX_MAX_REPEAT ||
+          (count->max > REGEX_MAX_REPEAT && count->max != REPEAT_INF)) {
+        fprintf(stderr, "error: EXPR: repetition count is more than %d\n",
+                REGEX_MAX_REPEAT);
+        exit(1);
+      }
+      if (count->min > count->max) {
+        fprintf(stderr, "error: EXPR: repetition minimum is more than "
+                "maximum\n");
+        exit(1);
+      }
+    }
     if (accept(Question, l)) {
       result->nchildren++;
       result->children[2] = terminal_tree((Token){Question, '?'});
@@ -206,7 +224,8 @@ PTree *REGEX(Lexer *l)
 
 bool CCHAR(Lexer *l)
 {
-  TSym acceptable[] = {CharSym, Dot, LParen, RParen, Plus, Star, Question, Pipe};
+  TSym acceptable[] = {CharSym, Dot, LParen, RParen, Plus, Star, Question, Pipe,
+                      Dollar};
   for (size_t i = 0; i < nelem(acceptable); i++) {
     if (accept(acceptable[i], l)) {
       l->prev.sym = CharSym;
@@ -279,6 +298,7 @@ PTree *reparse(char *regex)
   l.input = regex;
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
   l.tok = (Token){0};
 
   // Create a parse tree!
@@ -305,3 +325,25 @@ instr *recomp(char *regex, size_t *n)
   // Return code.
   return code;
 }
+
+/**
+   @brief Compile several regexes into one program.
+
+   Each match instruction is labelled with the index of its regex.  See
+   codegen_set().
+ */
+instr *recomp_set(char **regexes, size_t nregex, size_t *n)
+{
+  PTree **trees = calloc(nregex, sizeof(PTree *));
+  for (size_t i = 0; i < nregex; i++) {
+    trees[i] = reparse(regexes[i]);
+  }
+
+  instr *code = codegen_set(trees, nregex, n);
+
+  for (size_t i = 0; i < nregex; i++) {
+    free_tree(trees[i]);
+  }
+  free(trees);
+  return code;
+}
@@ -26,28 +26,15 @@
 #include <unistd.h>
 
 #include "regex.h"
-
-// Declarations:
-
-typedef struct thread thread;
-struct thread {
-  instr *pc;
-  size_t *saved;
-};
-
-typedef struct thread_list thread_list;
-struct thread_list {
-  thread *t;
-  size_t n;
-};
+#include "regparse.h"
 
 // Printing, for diagnostics
 
-void printthreads(thread_list *tl, instr *prog, size_t nsave) {
+void printthreads(thread_list *tl, pinstr *prog, size_t nsave) {
   for (size_t i = 0; i < tl->n; i++) {
     printf("T%zu@pc=%lu{", i, (intptr_t) (tl->t[i].pc - prog));
     for (size_t j = 0; j < nsave; j++) {
-      printf("%lu,", tl->t[i].saved[j]);
+      printf("%lu,", (unsigned long) tl->t[i].saved[j]);
     }
     printf("} ");
   }
@@ -56,20 +43,10 @@ void printthreads(thread_list *tl, instr *prog, size_t nsave) {
 
 // Helper evaluation functions for instructions
 
-bool range(instr in, char test) {
-  if (test == '\0') {
-    return false;
-  }
-  bool result = false;
-  char *block = (char *) in.x;
-
-  // use in.s for number of ranges, in.x as char* for ranges.
-  for (size_t i = 0; i < in.s; i++) {
-    if (block[i*2] <= test && test <= block [i*2 + 1]) {
-      result = true;
-      break; // short circuit yo!
-    }
-  }
+bool range(instr in, unsigned char test) {
+  // in.x is the charset (see charset.c), so this is a single bit lookup.
+  const unsigned char *set = (const unsigned char *) in.x;
+  bool result = set[test >> 3] & (1 << (test & 7));
 
   // negate result for negative ranges
   if (in.code == Range) {
@@ -79,158 +56,791 @@ bool range(instr in, char test) {
   }
 }
 
+/**
+   @brief Return whether a consuming instruction accepts a byte.
+
+   Every byte value (including NUL) is treated alike.  Bytes are compared as
+   unsigned, so ranges above 0x7f work as written.
+ */
+bool accepts(const instr *pc, unsigned char c)
+{
+  switch (pc->code) {
+  case Char:
+  case String:
+    return c == (unsigned char) pc->c;
+  case Any:
+    return true;
+  case Range:
+    return ((const unsigned char *) pc->x)[c >> 3] & (1 << (c & 7));
+  case NRange:
+    return !(((const unsigned char *) pc->x)[c >> 3] & (1 << (c & 7)));
+  default:
+    return false;
+  }
+}
+
+// Sparse set functions:
+
+void ss_init(sparse_set *ss, size_t n)
+{
+  ss->dense = calloc(n, sizeof(size_t));
+  // The algorithm doesn't require the sparse array to be initialized, but
+  // valgrind would complain about reading it.
+  ss->sparse = calloc(n, sizeof(size_t));
+  ss->n = 0;
+}
+
+void ss_free(sparse_set *ss)
+{
+  free(ss->dense);
+  free(ss->sparse);
+}
+
+void ss_clear(sparse_set *ss)
+{
+  ss->n = 0;
+}
+
+bool ss_contains(sparse_set *ss, size_t i)
+{
+  return ss->sparse[i] < ss->n && ss->dense[ss->sparse[i]] == i;
+}
+
+void ss_insert(sparse_set *ss, size_t i)
+{
+  ss->sparse[i] = ss->n;
+  ss->dense[ss->n++] = i;
+}
+
 // Pike VM functions:
 
-thread_list newthread_list(size_t n)
+thread_list newthread_list(size_t n, size_t nsave)
 {
   thread_list tl;
   tl.t = calloc(n, sizeof(thread));
+  tl.caps = calloc(n * nsave, sizeof(uint32_t));
   tl.n = 0;
   return tl;
 }
 
-void addthread(thread_list *threads, instr *pc, size_t *saved, size_t nsave,
-               size_t sp)
+static void free_thread_list(thread_list *tl)
 {
-  //printf("addthread(): pc=%d, saved={%u, %u}, sp=%u, lastidx=%u\n", pc - extprog,
-  //       saved[0], saved[1], sp, pc->lastidx);
-  if (pc->lastidx == sp) {
-    // we've executed this instruction on this string index already
-    free(saved);
-    return;
+  free(tl->t);
+  free(tl->caps);
+}
+
+/**
+   @brief Allocate a scratch for matching against a program.
+
+   The scratch is also used for scanning with the program's reversed code, so
+   it is sized for whichever code is longest.
+ */
+scratch *newscratch(const program *p)
+{
+  scratch *s = calloc(1, sizeof(scratch));
+  size_t n = p->n;
+  if (p->rev && p->rev->n > n) {
+    n = p->rev->n;
   }
-  pc->lastidx = sp;
+  if (inner_size(p->inner) > n) {
+    n = inner_size(p->inner);
+  }
+  s->proglen = n;
+  s->nsave = p->nsave;
+  s->nslot = p->nsave + 1;
+  // Can have at most n threads, where n is the length of the program.  This is
+  // because (as it is now) the thread state is simply a program counter.
+  s->curr = newthread_list(n, s->nslot);
+  s->next = newthread_list(n, s->nslot);
+  ss_init(&s->visited, n);
+  s->stack = calloc(n + 1, sizeof(job));
+  s->work = calloc(s->nslot, sizeof(uint32_t));
+  s->matched = calloc(s->nslot, sizeof(uint32_t));
+  s->bt = newbitstate(p);
+  return s;
+}
 
-  size_t *newsaved;
-  switch (pc->code) {
-  case Jump:
-    addthread(threads, pc->x, saved, nsave, sp);
-    break;
-  case Split:
-    newsaved = calloc(nsave, sizeof(size_t));
-    memcpy(newsaved, saved, nsave * sizeof(size_t));
-    addthread(threads, pc->x, saved, nsave, sp);
-    addthread(threads, pc->y, newsaved, nsave, sp);
-    break;
-  case Save:
-    saved[pc->s] = sp;
-    addthread(threads, pc + 1, saved, nsave, sp);
-    break;
-  default:
-    threads->t[threads->n].pc = pc;
-    threads->t[threads->n].saved = saved;
-    threads->n++;
-    break;
+void free_scratch(scratch *s)
+{
+  free_thread_list(&s->curr);
+  free_thread_list(&s->next);
+  ss_free(&s->visited);
+  free(s->stack);
+  free(s->work);
+  free(s->matched);
+  free_bitstate(s->bt);
+  free_jitstate(s->js);
+  free(s);
+}
+
+/**
+   @brief Add a thread (and its epsilon closure) to a thread list.
+
+   Rather than recursing through Jump, Split, Save and Assert instructions
+   (which only continue if their condition is in s->ctx), this keeps
+   an explicit stack of work in the scratch.  A Split pushes its second target,
+   so that it is explored after everything reachable from the first target,
+   which preserves thread priority.  A Save pushes the old value of its slot,
+   so that it is restored before any lower priority branch is explored.  Since
+   each instruction is visited at most once per string index, and pushes at
+   most one entry, the stack never holds more than one entry per instruction.
+
+   The saved array is used as working space, and is unchanged when this
+   returns.  Each thread that reaches a consuming instruction gets a copy of it
+   in its row of the capture matrix.
+ */
+void addthread(const program *p, scratch *s, thread_list *threads,
+               pinstr *pc, uint32_t *saved, size_t sp)
+{
+  size_t njob = 0;
+  s->stack[njob++] = (job){pc, 0, 0};
+
+  while (njob > 0) {
+    job j = s->stack[--njob];
+    if (j.pc == NULL) {
+      // Leaving the branch which saved this slot.
+      saved[j.slot] = j.value;
+      continue;
+    }
+
+    // Follow this branch until it reaches a consuming instruction, or an
+    // instruction we have already visited at this string index.
+    pc = j.pc;
+    while (pc != NULL) {
+      size_t idx = pc - p->vm->code;
+      if (ss_contains(&s->visited, idx)) {
+        break;
+      }
+      ss_insert(&s->visited, idx);
+
+      switch (pc->op) {
+      case Jump:
+        pc += pc->x;
+        break;
+      case Split:
+        s->stack[njob++] = (job){pc + pc->y, 0, 0};
+        pc += pc->x;
+        break;
+      case Save:
+        s->stack[njob++] = (job){NULL, pc->x, saved[pc->x]};
+        saved[pc->x] = sp;
+        pc = pc + 1;
+        break;
+      case Assert:
+        pc = (s->ctx & pc->x) ? pc + 1 : NULL;
+        break;
+      default:
+        threads->t[threads->n].pc = pc;
+        threads->t[threads->n].saved = threads->caps + threads->n * s->nslot;
+        memcpy(threads->t[threads->n].saved, saved,
+               s->nslot * sizeof(uint32_t));
+        threads->n++;
+        pc = NULL;
+        break;
+      }
+    }
   }
 }
 
 /**
-   @brief "Stash" a list of captures into the "out" pointer.
-   @param new The new list of captures encountered by the Match instruction.
+   @brief "Stash" the captures of the last match into the "out" pointer.
+   @param matched The captures encountered by the Match.
+   @param nsave Number of capture slots.
    @param destination The out pointer where the caller wants the captures.
  */
-void stash(size_t *new, size_t **destination)
+void stash(const uint32_t *matched, size_t nsave, size_t **destination)
 {
   if (!destination) {
-    /* If the user wants to discard the captures, they'll pass NULL.  This means
-       we need to get rid of the capture list, or we'll leak the memory. */
-    free(new);
+    /* If the user wants to discard the captures, they'll pass NULL. */
     return;
   }
-  if (*destination) {
-    /* If we have already stored a capture list, we should free that. */
-    free(*destination);
+  *destination = calloc(nsave, sizeof(size_t));
+  for (size_t i = 0; i < nsave; i++) {
+    (*destination)[i] = matched[i];
   }
-  /* Finally, stash the pointer away. */
-  *destination = new;
 }
 
-ssize_t execute(instr *prog, size_t proglen, char *input, size_t **saved)
+/**
+   @brief Add a new thread at the start of the program.
+   @param sp String index where the new thread starts matching.
+ */
+static void addstart(const program *p, scratch *s, thread_list *threads,
+                     size_t sp)
+{
+  for (size_t i = 0; i < s->nsave; i++) {
+    s->work[i] = s->unset;
+  }
+  s->work[s->nsave] = sp;
+  addthread(p, s, threads, p->vm->code, s->work, sp);
+}
+
+/**
+   @brief Reset a scratch to begin simulating the Pike VM.
+
+   This leaves a single thread (and its epsilon closure) at string index sp.
+   @param ctx Assertions which hold at sp (see lookaround()).
+ */
+void pike_begin(const program *p, scratch *s, size_t sp, unsigned ctx)
+{
+  assert(s->proglen >= p->n && s->nsave >= p->nsave);
+
+  s->curr.n = 0;
+  s->next.n = 0;
+
+  // Start with a single thread and add more as we need.  Note that addthread()
+  // will execute instructions that don't consume input (i.e. epsilon closure).
+  ss_clear(&s->visited);
+  s->ctx = ctx;
+  addstart(p, s, &s->curr, sp);
+}
+
+/**
+   @brief Step every thread over the byte at one string index.
+
+   When searching, a new lowest priority thread is started at each string index
+   (after the threads already running), until one of them matches.  Since new
+   threads can only produce matches starting later, the VM may stop as soon as
+   a match has been found and every higher priority thread has died (that is,
+   when no threads are left).
+   @param c The byte at index sp, or -1 at the end of input.
+   @param next The byte at index sp+1, or -1 if there is none.  This is only
+   used by assertions for the end of a line or of the text.
+   @param sp String index of the threads in the current list.
+   @param inject Whether to start a new thread at index sp+1 (if nothing has
+   matched yet).
+   @param[in,out] match Index of the end of the last match (or -1), updated if a
+   thread matches, in which case its captures are copied to s->matched.
+ */
+void pike_step(const program *p, scratch *s, int c, int next, size_t sp,
+               bool inject, ssize_t *match)
 {
-  // Can have at most n threads, where n is the length of the program.  This is
-  // because (as it is now) the thread state is simply a program counter.
-  thread_list curr = newthread_list(proglen);
-  thread_list next = newthread_list(proglen);
   thread_list temp;
-  size_t nsave = 0;
+
+  //printf("consider input %c\nthreads: ", c);
+  //printthreads(&s->curr, p->vm->code, s->nslot);
+
+  // Threads added to the next list are at index sp+1.
+  ss_clear(&s->visited);
+  s->ctx = lookaround(c, next);
+
+  // Execute each thread (this will only ever reach instructions that consume
+  // input, since addthread() stops with those).
+  for (size_t t = 0; t < s->curr.n; t++) {
+    pinstr *pc = s->curr.t[t].pc;
+
+    switch (pc->op) {
+    case Char:
+    case String:
+    case Any:
+    case Range:
+    case NRange:
+      if (c < 0 || !paccepts(p->vm, pc, c)) {
+        break; // fail, don't continue executing this thread
+      }
+      if (pc->y > 0) {
+        // Inside a literal run, the next instruction is a Char which nothing
+        // jumps to, so the thread just moves along without a closure.
+        thread *next = &s->next.t[s->next.n];
+        next->pc = pc + 1;
+        next->saved = s->next.caps + s->next.n * s->nslot;
+        memcpy(next->saved, s->curr.t[t].saved, s->nslot * sizeof(uint32_t));
+        s->next.n++;
+        break;
+      }
+      // add thread containing the next instruction to the next thread list.
+      addthread(p, s, &s->next, pc+1, s->curr.t[t].saved, sp+1);
+      break;
+    case Match:
+      memcpy(s->matched, s->curr.t[t].saved, s->nslot * sizeof(uint32_t));
+      *match = sp;
+      goto cont;
+    default:
+      assert(false);
+      break;
+    }
+  }
+
+cont:
+  // Until something matches, start a new thread at the next index.
+  if (inject && *match == -1) {
+    addstart(p, s, &s->next, sp + 1);
+  }
+
+  // Swap the curr and next lists.
+  temp = s->curr;
+  s->curr = s->next;
+  s->next = temp;
+
+  // Reset our new next list.
+  s->next.n = 0;
+}
+
+/**
+   @brief Simulate the Pike VM on a buffer.
+
+   When searching a program with a prefilter, threads are only started where
+   the prefilter says a match could begin, and whenever no thread is running,
+   the VM skips straight to the next such index.  The same goes for a program
+   anchored to the beginning of the text or of a line (see anchor.c).
+   @param anchored Whether the match must begin at the start of input.
+   @param[out] start Where to put the start of the match (may be NULL).
+ */
+ssize_t pikevm(const program *p, scratch *s, const unsigned char *buf,
+               size_t len, bool anchored, size_t *start, size_t **saved)
+{
+  const prefilter *pf = anchored ? NULL : p->prefilter;
+  // With assertions, a thread started at one index may die where one started
+  // at a later index would not, so running out of threads isn't the end.
+  bool restart = !anchored && (pf != NULL || p->assertions != 0);
   ssize_t match = -1;
+  size_t sp = 0;
 
-  // Set the out pointer to NULL so that stash() knows whether we've already
-  // stashed away a capture list.
   if (saved) {
     *saved = NULL;
   }
 
-  // Need to initialize lastidx to something that will never be used.
-  for (size_t i = 0; i < proglen; i++) {
-    prog[i].lastidx = (size_t)-1;
-    if (prog[i].code == Save) {
-      nsave++;
+  if (restart) {
+    sp = anchor_next(p, pf, buf, len, 0);
+    if (sp > len) {
+      return -1;
     }
   }
 
-  // Start with a single thread and add more as we need.  Note that addthread()
-  // will execute instructions that don't consume input (i.e. epsilon closure).
-  addthread(&curr, prog, calloc(nsave, sizeof(size_t)), nsave, 0);
+  pike_begin(p, s, sp, lookaround_at(buf, len, sp));
+  while (true) {
+    if (s->curr.n == 0) {
+      if (!restart || match != -1) {
+        break;
+      }
+      // Nothing is running: skip ahead to where a match could begin.
+      sp = anchor_next(p, pf, buf, len, sp + 1);
+      if (sp > len) {
+        break;
+      }
+      pike_begin(p, s, sp, lookaround_at(buf, len, sp));
+      continue;
+    }
+
+    bool inject = !anchored && sp < len && anchor_allows(p, buf, sp + 1) &&
+      (pf == NULL || (sp + 1 < len && prefilter_first(pf, buf[sp + 1])));
+    pike_step(p, s, sp < len ? buf[sp] : -1, sp + 1 < len ? buf[sp + 1] : -1,
+              sp, inject, &match);
+    sp++;
+  }
 
+  if (match != -1) {
+    stash(s->matched, p->nsave, saved);
+    if (start) {
+      *start = s->matched[s->nsave];
+    }
+  }
+  return match;
+}
+
+/**
+   @brief Simulate the Pike VM, starting threads only within a window.
+
+   This finds the match pikevm() would find, if every match had to begin
+   between from and to (inclusive).  It stops as soon as no thread is left, and
+   no more may be started.
+   @param from First index where a match may begin.
+   @param to Last index where a match may begin.
+   @param[out] start Where to put the start of the match (may be NULL).
+   @param[out] stop Where to put the index at which the VM stopped (may be
+   NULL).
+ */
+ssize_t pike_window(const program *p, scratch *s, const unsigned char *buf,
+                    size_t len, size_t from, size_t to, size_t *start,
+                    size_t **saved, size_t *stop)
+{
+  ssize_t match = -1;
   size_t sp;
-  for (sp = 0; curr.n > 0; sp++) {
-
-    //printf("consider input %c\nthreads: ", input[sp]);
-    //printthreads(&curr, prog, nsave);
-
-    // Execute each thread (this will only ever reach instructions that consume
-    // input, since addthread() stops with those).
-    for (size_t t = 0; t < curr.n; t++) {
-      instr *pc = curr.t[t].pc;
-
-      switch (pc->code) {
-      case Char:
-        if (input[sp] != pc->c) {
-          free(curr.t[t].saved);
-          break; // fail, don't continue executing this thread
-        }
-        // add thread containing the next instruction to the next thread list.
-        addthread(&next, pc+1, curr.t[t].saved, nsave, sp+1);
-        break;
-      case Any:
-        if (input[sp] == '\0') {
-          free(curr.t[t].saved);
-          break; // dot can't match end of string!
-        }
-        // add thread containing the next instruction to the next thread list.
-        addthread(&next, pc+1, curr.t[t].saved, nsave, sp+1);
-        break;
-      case Range:
-      case NRange:
-        if (!range(*pc, input[sp])) {
-          free(curr.t[t].saved);
-          break;
-        }
-        addthread(&next, pc+1, curr.t[t].saved, nsave, sp+1);
+
+  if (saved) {
+    *saved = NULL;
+  }
+
+  pike_begin(p, s, from, lookaround_at(buf, len, from));
+  for (sp = from; s->curr.n > 0 || (match == -1 && sp < to); sp++) {
+    pike_step(p, s, sp < len ? buf[sp] : -1, sp + 1 < len ? buf[sp + 1] : -1,
+              sp, sp < to && sp < len, &match);
+  }
+  if (stop) {
+    *stop = sp;
+  }
+
+  if (match != -1) {
+    stash(s->matched, p->nsave, saved);
+    if (start) {
+      *start = s->matched[s->nsave];
+    }
+  }
+  return match;
+}
+
+/**
+   @brief Run the backtracker, and report its results like pikevm() does.
+
+   If the program has native code, that is run instead of the interpreter.
+ */
+static ssize_t bt(const program *p, scratch *s, const unsigned char *buf,
+                  size_t len, bool anchored, size_t *start, size_t **saved)
+{
+  ssize_t match = p->jit ? jit_exec(p, s, buf, len, anchored)
+                         : backtrack(p, s->bt, buf, len, anchored, s->matched);
+  if (saved) {
+    *saved = NULL;
+  }
+  if (match != -1) {
+    stash(s->matched, p->nsave, saved);
+    if (start) {
+      *start = s->matched[p->nsave];
+    }
+  }
+  return match;
+}
+
+/**
+   @brief Run a program against a buffer of bytes, using the given scratch.
+
+   The match must begin at the start of the buffer.  All 256 byte values are
+   treated alike (NUL is an ordinary byte), so this may be used directly on
+   binary data, network buffers or mapped files, without copying.  The program
+   itself is never modified, so any number of threads may run the same program
+   at once, provided each has its own scratch.  No memory is allocated while
+   stepping through the input; captures are tracked in the scratch, so input
+   must be shorter than 4GiB.
+
+   When the program is one-pass, the deterministic matcher in onepass.c is used
+   instead of the Pike VM.  Otherwise, when the input is short enough, the
+   backtracker in backtrack.c is used (or the program's native code, from
+   jit_compile(), which fits much longer inputs).  All of them give the same
+   results.
+   @param p Program to run.
+   @param s Scratch allocated for this program by newscratch().
+   @param buf Bytes to match.
+   @param len Number of bytes in buf.
+   @param[out] saved Where to put the capture list (may be NULL).
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t run_bytes(const program *p, scratch *s, const unsigned char *buf,
+                  size_t len, size_t **saved)
+{
+  assert(len <= UINT32_MAX);
+  if (p->onepass) {
+    ssize_t match = onepass_exec(p->onepass, buf, len, s->work, s->matched);
+    if (saved) {
+      *saved = NULL;
+    }
+    if (match != -1) {
+      stash(s->matched, p->nsave, saved);
+    }
+    return match;
+  }
+  if ((p->jit && jit_fits(p->n, len)) || backtrack_fits(p->n, len)) {
+    return bt(p, s, buf, len, true, NULL, saved);
+  }
+  return pikevm(p, s, buf, len, true, NULL, saved);
+}
+
+/**
+   @brief Run a program against a NUL-terminated string.
+
+   This is run_bytes() on the string, not including its terminator.
+ */
+ssize_t run(const program *p, scratch *s, char *input, size_t **saved)
+{
+  return run_bytes(p, s, (unsigned char *) input, strlen(input), saved);
+}
+
+/**
+   @brief Search for the leftmost match of a program anywhere in a buffer.
+
+   Among matches starting at the leftmost possible index, the one preferred by
+   the program's priorities (greedy or non-greedy operators, and alternation
+   order) is reported, just like run().  This is cheaper than wrapping the
+   regex in ".*", since no thread is started after the first match is found.
+   Like run_bytes(), every byte value is treated alike.
+
+   On long inputs, a program with an inner literal is searched with
+   inner_search(), which only runs the VM near occurrences of the literal.  A
+   program (from compile()) whose matches must all end at the end of the text
+   is run backwards from there instead, with its reversed code.  Otherwise, a
+   program with native code (see jit_compile()) runs that on inputs it fits.
+   @param p Program to run.
+   @param s Scratch allocated for this program by newscratch().
+   @param buf Bytes to search.
+   @param len Number of bytes in buf.
+   @param[out] start Where to put the start index of the match (may be NULL).
+   @param[out] saved Where to put the capture list (may be NULL).
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t search_bytes(const program *p, scratch *s, const unsigned char *buf,
+                     size_t len, size_t *start, size_t **saved)
+{
+  assert(len <= UINT32_MAX);
+  if ((p->anchors & EndText) && p->rev) {
+    // Every match ends at len, so the leftmost one begins at the earliest index
+    // from which the reversed code matches back to len.
+    size_t from = reverse_scan(p->rev, s, buf, len, 0, len);
+    if (from > len) {
+      if (saved) {
+        *saved = NULL;
+      }
+      return -1;
+    } else if (saved) {
+      return pike_window(p, s, buf, len, from, from, start, saved, NULL);
+    }
+    if (start) {
+      *start = from;
+    }
+    return len;
+  }
+  if (backtrack_fits(p->n, len)) {
+    return bt(p, s, buf, len, false, start, saved);
+  }
+  if (p->inner && !(p->anchors & BeginText)) {
+    return inner_search(p, s, buf, len, start, saved);
+  }
+  if (p->jit && jit_fits(p->n, len)) {
+    return bt(p, s, buf, len, false, start, saved);
+  }
+  return pikevm(p, s, buf, len, false, start, saved);
+}
+
+/**
+   @brief Search for the leftmost match of a program in a NUL-terminated string.
+ */
+ssize_t search(const program *p, scratch *s, char *input, size_t *start,
+               size_t **saved)
+{
+  return search_bytes(p, s, (unsigned char *) input, strlen(input), start,
+                      saved);
+}
+
+/**
+   @brief Copy the captures of the last match from a scratch.
+ */
+static void copycaps(const program *p, const scratch *s, size_t *caps)
+{
+  for (size_t i = 0; i < p->nsave; i++) {
+    caps[i] = s->matched[i];
+  }
+}
+
+/**
+   @brief Like run_bytes(), but write captures into a caller-owned array.
+
+   Together with a scratch which is reused between calls, this lets a match do
+   no allocation at all, and no setup proportional to the program's length.
+   @param p Program to run.
+   @param s Scratch allocated for this program by newscratch().
+   @param buf Bytes to match.
+   @param len Number of bytes in buf.
+   @param[out] caps Where to put the captures (numsaves() entries), if there is
+   a match.  Left alone otherwise.  May be NULL.
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t run_into(const program *p, scratch *s, const unsigned char *buf,
+                 size_t len, size_t *caps)
+{
+  ssize_t match = run_bytes(p, s, buf, len, NULL);
+  if (match != -1 && caps) {
+    copycaps(p, s, caps);
+  }
+  return match;
+}
+
+/**
+   @brief Like search_bytes(), but write captures into a caller-owned array.
+   @param[out] start Where to put the start of the match (may be NULL).
+   @param[out] caps Where to put the captures (numsaves() entries), if there is
+   a match.  Left alone otherwise.  May be NULL.
+   @returns Index of the end of the match, or -1 if there is no match.
+ */
+ssize_t search_into(const program *p, scratch *s, const unsigned char *buf,
+                    size_t len, size_t *start, size_t *caps)
+{
+  ssize_t match = search_bytes(p, s, buf, len, start, NULL);
+  if (match != -1 && caps) {
+    copycaps(p, s, caps);
+  }
+  return match;
+}
+
+/**
+   @brief Add an instruction's epsilon closure to a list, ignoring captures.
+
+   Only the instruction of each thread is set.  Save instructions are skipped.
+   @returns Whether a Match was reached.
+ */
+static bool addpc(const program *p, scratch *s, thread_list *threads,
+                  pinstr *pc)
+{
+  bool match = false;
+  size_t njob = 0;
+  s->stack[njob++] = (job){pc, 0, 0};
+
+  while (njob > 0) {
+    pc = s->stack[--njob].pc;
+    while (pc != NULL) {
+      size_t idx = pc - p->vm->code;
+      if (ss_contains(&s->visited, idx)) {
+        break;
+      }
+      ss_insert(&s->visited, idx);
+
+      switch (pc->op) {
+      case Jump:
+        pc += pc->x;
+        break;
+      case Split:
+        s->stack[njob++] = (job){pc + pc->y, 0, 0};
+        pc += pc->x;
+        break;
+      case Save:
+        pc = pc + 1;
+        break;
+      case Assert:
+        pc = (s->ctx & pc->x) ? pc + 1 : NULL;
         break;
       case Match:
-        stash(curr.t[t].saved, saved);
-        match = sp;
-        goto cont;
+        match = true;
+        pc = NULL;
+        break;
       default:
-        assert(false);
+        threads->t[threads->n++].pc = pc;
+        pc = NULL;
         break;
       }
     }
+  }
+  return match;
+}
+
+/**
+   @brief Return whether a program matches a buffer at all.
+
+   This is for when only a yes or no answer is needed.  Since it doesn't matter
+   which match would be preferred, threads have no priority and no captures,
+   and the answer is returned as soon as any thread reaches a Match.  Nothing is
+   copied per thread, and the scratch is the only memory used.
+   @param p Program to run.
+   @param s Scratch allocated for this program by newscratch().
+   @param buf Bytes to match.
+   @param len Number of bytes in buf.
+   @param anchored Whether the match must begin at the start of the buffer (as
+   in run_bytes()).  Otherwise, it may begin anywhere (as in search_bytes()).
+ */
+bool is_match(const program *p, scratch *s, const unsigned char *buf,
+              size_t len, bool anchored)
+{
+  const prefilter *pf = anchored ? NULL : p->prefilter;
+  bool restart = !anchored && (pf != NULL || p->assertions != 0);
+  size_t sp = 0;
+
+  if (!anchored && (p->anchors & EndText) && p->rev) {
+    // Every match ends at len, so look backwards from there.
+    return reverse_scan(p->rev, s, buf, len, 0, len) <= len;
+  }
+  if (restart) {
+    sp = anchor_next(p, pf, buf, len, 0);
+    if (sp > len) {
+      return false;
+    }
+  }
+
+  ss_clear(&s->visited);
+  s->curr.n = 0;
+  s->ctx = lookaround_at(buf, len, sp);
+  if (addpc(p, s, &s->curr, p->vm->code)) {
+    return true;
+  }
+
+  while (true) {
+    if (s->curr.n == 0) {
+      if (!restart) {
+        return false;
+      }
+      // Nothing is running: skip ahead to where a match could begin.
+      sp = anchor_next(p, pf, buf, len, sp + 1);
+      if (sp > len) {
+        return false;
+      }
+      ss_clear(&s->visited);
+      s->ctx = lookaround_at(buf, len, sp);
+      if (addpc(p, s, &s->curr, p->vm->code)) {
+        return true;
+      }
+      continue;
+    }
+    if (sp == len) {
+      return false;
+    }
+
+    ss_clear(&s->visited);
+    s->ctx = lookaround_at(buf, len, sp + 1);
+    s->next.n = 0;
+    for (size_t t = 0; t < s->curr.n; t++) {
+      pinstr *pc = s->curr.t[t].pc;
+      if (!paccepts(p->vm, pc, buf[sp])) {
+        continue;
+      }
+      if (pc->y > 0) {
+        s->next.t[s->next.n++].pc = pc + 1; // inside a literal run
+      } else if (addpc(p, s, &s->next, pc + 1)) {
+        return true;
+      }
+    }
+    if (!anchored && anchor_allows(p, buf, sp + 1) &&
+        (pf == NULL || (sp + 1 < len && prefilter_first(pf, buf[sp + 1]))) &&
+        addpc(p, s, &s->next, p->vm->code)) {
+      return true;
+    }
 
-  cont:
-    // Swap the curr and next lists.
-    temp = curr;
-    curr = next;
-    next = temp;
+    thread_list temp = s->curr;
+    s->curr = s->next;
+    s->next = temp;
+    sp++;
+  }
+}
 
-    // Reset our new next list.
-    next.n = 0;
+/**
+   @brief Run a program against an input string.
+
+   This is a convenience wrapper around run(), which allocates a scratch for
+   this call only.  If you match against the same program repeatedly, create a
+   program and a scratch once, and use run() instead.
+ */
+ssize_t execute(instr *prog, size_t proglen, char *input, size_t **saved)
+{
+  program p;
+  size_t len = strlen(input);
+
+  if (backtrack_fits(proglen, len)) {
+    // Short input: skip analyzing the program and allocating a whole scratch.
+    p = (program){.code = prog, .n = proglen,
+                  .nsave = numsaves(prog, proglen)};
+    bitstate *b = newbitstate(&p);
+    uint32_t *matched = calloc(p.nsave + 1, sizeof(uint32_t));
+    ssize_t match = backtrack(&p, b, (unsigned char *) input, len, true,
+                              matched);
+    if (saved) {
+      *saved = NULL;
+    }
+    if (match != -1) {
+      stash(matched, p.nsave, saved);
+    }
+    free(matched);
+    free_bitstate(b);
+    return match;
   }
 
-  free(curr.t);
-  free(next.t);
+  init_program(&p, prog, proglen);
+  scratch *s = newscratch(&p);
+  ssize_t match = run_bytes(&p, s, (unsigned char *) input, len, saved);
+  free_scratch(s);
+  cleanup_program(&p);
   return match;
 }
 
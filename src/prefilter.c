@@ -0,0 +1,219 @@
+/***************************************************************************//**
+
+  @file         prefilter.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Skipping input where no match can start.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on prefilters:
+
+  When searching, the Pike VM starts a thread at every index of the input.  But
+  if every match must begin with a certain byte (or string), most of those
+  threads die immediately.  So, when a program is created, we look at what every
+  match must begin with:
+
+  - The literal prefix: the Char instructions reached from the start of the
+    program before anything else consumes input or branches.  "ERROR: (\w+)"
+    has the prefix "ERROR: ".
+  - The first byte set: every byte accepted by a consuming instruction in the
+    epsilon closure of the start.  "[0-9]+|x" has the set {0-9, x}.
+
+  While no thread is running, the search can then jump straight to the next
+  place the prefix occurs (using memchr() and memcmp()), or the next byte in
+  the set, without running the VM at all.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+struct prefilter {
+  unsigned char *prefix; // bytes every match begins with
+  size_t nprefix;
+  bool first[256];       // bytes a match may begin with
+};
+
+/**
+   @brief Return the literal prefix of a program.
+   @param[out] n Where to put the length of the prefix.
+ */
+static unsigned char *literal_prefix(const program *p, size_t *n)
+{
+  unsigned char *prefix = calloc(p->n + 1, sizeof(unsigned char));
+  instr *pc = p->code;
+  *n = 0;
+
+  // Each instruction is visited at most once, since Jumps could loop.
+  for (size_t steps = 0; steps < p->n && pc < p->code + p->n; steps++) {
+    if (pc->code == Save || pc->code == Assert) {
+      pc++;
+    } else if (pc->code == Jump) {
+      pc = pc->x;
+    } else if (pc->code == Char || pc->code == String) {
+      prefix[(*n)++] = pc->c;
+      pc++;
+    } else {
+      break;
+    }
+  }
+  return prefix;
+}
+
+/**
+   @brief Find the set of bytes a match may begin with.
+   @returns false if an empty match is possible (so there is no such set).
+ */
+static bool first_bytes(const program *p, bool *first)
+{
+  sparse_set visited;
+  instr **stack = calloc(p->n + 1, sizeof(instr *));
+  size_t nstack = 0;
+  bool ok = true;
+
+  ss_init(&visited, p->n);
+  stack[nstack++] = p->code;
+  while (ok && nstack > 0) {
+    instr *pc = stack[--nstack];
+    while (pc != NULL) {
+      size_t idx = pc - p->code;
+      if (ss_contains(&visited, idx)) {
+        break;
+      }
+      ss_insert(&visited, idx);
+
+      switch (pc->code) {
+      case Jump:
+        pc = pc->x;
+        break;
+      case Split:
+        stack[nstack++] = pc->y;
+        pc = pc->x;
+        break;
+      case Save:
+      case Assert:
+        pc = pc + 1;
+        break;
+      case Match:
+        ok = false;
+        pc = NULL;
+        break;
+      default:
+        for (int c = 0; c < 256; c++) {
+          first[c] = first[c] || accepts(pc, c);
+        }
+        pc = NULL;
+        break;
+      }
+    }
+  }
+
+  ss_free(&visited);
+  free(stack);
+  return ok;
+}
+
+/**
+   @brief Analyze a program for a prefilter.
+   @returns The prefilter, or NULL if a match could begin anywhere.
+ */
+prefilter *prefilter_compile(const program *p)
+{
+  prefilter *pf = calloc(1, sizeof(prefilter));
+  size_t nfirst = 0;
+
+  pf->prefix = literal_prefix(p, &pf->nprefix);
+  if (pf->nprefix > 0) {
+    pf->first[pf->prefix[0]] = true;
+    nfirst = 1;
+  } else if (first_bytes(p, pf->first)) {
+    for (int c = 0; c < 256; c++) {
+      nfirst += pf->first[c];
+    }
+  }
+
+  if (nfirst == 0 || nfirst == 256) {
+    // Either an empty match is possible, or any byte may begin a match.
+    free_prefilter(pf);
+    return NULL;
+  }
+  return pf;
+}
+
+/**
+   @brief Create a prefilter which finds occurrences of a literal.
+   @param lit Bytes of the literal (copied).
+   @param n Length of the literal (at least one).
+ */
+prefilter *prefilter_literal(const unsigned char *lit, size_t n)
+{
+  prefilter *pf = calloc(1, sizeof(prefilter));
+  pf->prefix = calloc(n, sizeof(unsigned char));
+  memcpy(pf->prefix, lit, n);
+  pf->nprefix = n;
+  pf->first[lit[0]] = true;
+  return pf;
+}
+
+void free_prefilter(prefilter *pf)
+{
+  if (pf == NULL) {
+    return;
+  }
+  free(pf->prefix);
+  free(pf);
+}
+
+/**
+   @brief Return whether a match could begin with a byte.
+ */
+bool prefilter_first(const prefilter *pf, unsigned char c)
+{
+  return pf->first[c];
+}
+
+/**
+   @brief Find the next index where a match could begin.
+   @param pf Prefilter from prefilter_compile().
+   @param buf Bytes to search.
+   @param len Number of bytes in buf.
+   @param sp Index to start looking from.
+   @returns The first candidate index at or after sp, or len + 1 if there is
+   none.
+ */
+size_t prefilter_next(const prefilter *pf, const unsigned char *buf,
+                      size_t len, size_t sp)
+{
+  if (pf->nprefix > 0) {
+    while (sp + pf->nprefix <= len) {
+      const unsigned char *found = memchr(buf + sp, pf->prefix[0],
+                                          len - sp - pf->nprefix + 1);
+      if (found == NULL) {
+        break;
+      }
+      sp = found - buf;
+      if (memcmp(found + 1, pf->prefix + 1, pf->nprefix - 1) == 0) {
+        return sp;
+      }
+      sp++;
+    }
+    return len + 1;
+  }
+
+  for (; sp < len; sp++) {
+    if (pf->first[buf[sp]]) {
+      return sp;
+    }
+  }
+  return len + 1;
+}
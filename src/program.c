@@ -0,0 +1,130 @@
+/***************************************************************************//**
+
+  @file         program.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Compiled program objects.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+/**
+   @brief Divide the bytes into classes which no instruction tells apart.
+
+   Every consuming instruction accepts either all or none of the bytes in each
+   class, so DFA-style tables can have one column per class instead of one per
+   byte.  Each class is a run of consecutive bytes: a new class begins wherever
+   some instruction accepts a byte but not the one before it (or vice versa).
+ */
+static void byteclasses(program *p)
+{
+  bool boundary[257] = {false};
+
+  for (size_t i = 0; i < p->n; i++) {
+    instr *pc = &p->code[i];
+    if (pc->code == Char || pc->code == String) {
+      boundary[(unsigned char) pc->c] = true;
+      boundary[(unsigned char) pc->c + 1] = true;
+    } else if (pc->code == Range || pc->code == NRange) {
+      unsigned char *set = (unsigned char *) pc->x;
+      for (int c = 1; c < 256; c++) {
+        if (charset_has(set, c) != charset_has(set, c - 1)) {
+          boundary[c] = true;
+        }
+      }
+    }
+  }
+
+  p->nclass = 0;
+  for (int c = 0; c < 256; c++) {
+    if (c > 0 && boundary[c]) {
+      p->nclass++;
+    }
+    p->classes[c] = p->nclass;
+  }
+  p->nclass++;
+}
+
+/**
+   @brief Initialize a program structure, and analyze its code.
+
+   The code is not copied, and cleanup_program() does not free it.
+ */
+void init_program(program *p, instr *code, size_t n)
+{
+  p->code = code;
+  p->n = n;
+  p->nsave = numsaves(code, n);
+  p->vm = pack(code, n);
+  byteclasses(p);
+  anchor_compile(p);
+  p->onepass = onepass_compile(p);
+  p->prefilter = prefilter_compile(p);
+  p->inner = NULL;
+  p->rev = NULL;
+  p->jit = NULL;
+}
+
+/**
+   @brief Free everything init_program() allocated.
+ */
+void cleanup_program(program *p)
+{
+  free_onepass(p->onepass);
+  free_prefilter(p->prefilter);
+  free_pprog(p->vm);
+  free_inner(p->inner);
+  free_pprog(p->rev);
+  free_jit(p->jit);
+}
+
+/**
+   @brief Create a program from already generated code.
+
+   The program takes ownership of the code, which is freed by free_program().
+   @param code Instructions, as returned by recomp() or read_prog().
+   @param n Number of instructions.
+ */
+program *newprogram(instr *code, size_t n)
+{
+  program *p = calloc(1, sizeof(program));
+  init_program(p, code, n);
+  return p;
+}
+
+/**
+   @brief Compile a regular expression into a program.
+
+   Unlike newprogram(), this has the parse tree, so it also looks for an inner
+   literal (see inner.c), and generates reversed code (see reverse.c).
+ */
+program *compile(char *regex)
+{
+  size_t n, nrev;
+  PTree *tree = reparse(regex);
+  instr *code = codegen(tree, &n);
+  program *p = newprogram(code, n);
+  p->inner = inner_compile(tree);
+  instr *rev = codegen_reverse(tree, &nrev);
+  p->rev = pack(rev, nrev);
+  free_prog(rev, nrev);
+  free_tree(tree);
+  return p;
+}
+
+void free_program(program *p)
+{
+  cleanup_program(p);
+  free_prog(p->code, p->n);
+  free(p);
+}
@@ -16,24 +16,99 @@
 #ifndef SMB_PIKE_REGEX_H
 #define SMB_PIKE_REGEX_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <unistd.h>
 
 // DEFINITIONS
 
 enum code {
-  Char, Match, Jump, Split, Save, Any, Range, NRange
+  Char, Match, Jump, Split, Save, Any, Range, NRange, String, Assert
 };
 
+/*
+  An Assert matches the empty string, but only where its condition (in s)
+  holds.  Each condition is a bit, so the conditions which hold at a string
+  index can be found once, and tested against any Assert with a single mask.
+ */
+enum assertion {
+  BeginText = 1, EndText = 2, BeginLine = 4, EndLine = 8
+};
+
+/*
+  A String starts a run of s literal bytes, and x points to all of them.  It is
+  followed by a Char for each byte after the first, so that every byte of the
+  run still has its own instruction (only the String may be jumped to).
+ */
 typedef struct instr instr;
 struct instr {
   enum code code; // opcode
-  char c;         // character
-  size_t s;       // slot for "saving" a string index
-  instr *x, *y;   // targets for jump and split
-  size_t lastidx; // used by Pike VM for fast membership testing
+  char c;         // character (for a String, the first one)
+  size_t s;       // slot for "saving" a string index (or length of a string)
+  instr *x, *y;   // targets for jump and split (x is a charset for ranges)
+};
+
+/**
+   @brief A packed instruction, as run by the Pike VM (see packed.c).
+ */
+typedef struct pinstr pinstr;
+struct pinstr {
+  unsigned op : 8;  // opcode
+  signed y : 24;    // second target for split, relative to this instruction
+                    // (or for a String or Char, bytes left in the run)
+  int32_t x;        // target, byte, slot, or charset index (depends on op)
+};
+
+/**
+   @brief Packed code, and the charsets it refers to.
+ */
+typedef struct pprog pprog;
+struct pprog {
+  pinstr *code;
+  size_t n;
+  unsigned char *sets; // nsets charsets of CHARSET_BYTES each
+  size_t nsets;
+};
+
+/**
+   @brief A compiled program, ready to be matched against input.
+
+   Nothing in a program is modified during matching.  All per-match state lives
+   in a separate scratch (see newscratch()), so a single program may be shared
+   by any number of threads, as long as each of them uses its own scratch.  The
+   one exception is jit_compile(), which adds native code to a program, and so
+   must be called before the program is shared.
+ */
+typedef struct onepass onepass;
+typedef struct prefilter prefilter;
+typedef struct inner inner;
+typedef struct jitcode jitcode;
+typedef struct program program;
+struct program {
+  instr *code;    // bytecode
+  size_t n;       // number of instructions
+  pprog *vm;      // packed bytecode, which the Pike VM runs
+  size_t nsave;   // number of capture slots (see numsaves())
+  onepass *onepass; // tables for deterministic matching, if possible
+  prefilter *prefilter; // where matches may begin, for searching (or NULL)
+  inner *inner;   // literal required inside every match (or NULL)
+  pprog *rev;     // reversed code, for finding where matches begin (or NULL)
+  unsigned assertions; // every kind of Assert in the code
+  unsigned anchors; // where every match must begin and end (see anchor.c)
+  jitcode *jit;   // native code, once jit_compile() succeeds (or NULL)
+  unsigned char classes[256]; // equivalence class of each byte
+  size_t nclass;  // number of byte classes
 };
 
+/**
+   @brief Per-match working memory for the Pike VM (opaque).
+
+   A scratch is sized for one program, and may be reused for any number of
+   matches against that program, but only by one thread at a time.
+ */
+typedef struct scratch scratch;
+
 // Read/Write Programs
 instr *read_prog(char *str, size_t *ninstr);
 instr *fread_prog(FILE *f, size_t *ninstr);
@@ -42,11 +117,93 @@ void free_prog(instr *prog, size_t n);
 
 // parser.c
 instr *recomp(char *regex, size_t *n);
+instr *recomp_set(char **regexes, size_t nregex, size_t *n);
+
+// program.c
+program *newprogram(instr *code, size_t n);
+program *compile(char *regex);
+void free_program(program *p);
 
 // pike.c
+scratch *newscratch(const program *p);
+void free_scratch(scratch *s);
+ssize_t run_bytes(const program *p, scratch *s, const unsigned char *buf,
+                  size_t len, size_t **saved);
+ssize_t run(const program *p, scratch *s, char *input, size_t **saved);
+ssize_t search_bytes(const program *p, scratch *s, const unsigned char *buf,
+                     size_t len, size_t *start, size_t **saved);
+ssize_t search(const program *p, scratch *s, char *input, size_t *start,
+               size_t **saved);
+ssize_t run_into(const program *p, scratch *s, const unsigned char *buf,
+                 size_t len, size_t *caps);
+ssize_t search_into(const program *p, scratch *s, const unsigned char *buf,
+                    size_t len, size_t *start, size_t *caps);
+bool is_match(const program *p, scratch *s, const unsigned char *buf,
+              size_t len, bool anchored);
 ssize_t execute(instr *prog, size_t proglen, char *input, size_t **saved);
 int numsaves(instr *code, size_t ncode);
 
+// dfa.c
+typedef struct dfa dfa;
+dfa *newdfa(const program *p, size_t maxstates);
+void free_dfa(dfa *d);
+ssize_t dfa_run_bytes(dfa *d, const unsigned char *buf, size_t len,
+                      size_t **saved);
+ssize_t dfa_run(dfa *d, char *input, size_t **saved);
+ssize_t dfa_search_bytes(dfa *d, const unsigned char *buf, size_t len,
+                         size_t *start, size_t **saved);
+ssize_t dfa_search(dfa *d, char *input, size_t *start, size_t **saved);
+
+// fulldfa.c
+typedef struct fulldfa fulldfa;
+fulldfa *newfulldfa(const program *p, bool anchored, size_t maxstates);
+void free_fulldfa(fulldfa *f);
+size_t fulldfa_nstates(const fulldfa *f);
+ssize_t fulldfa_exec_bytes(const fulldfa *f, const unsigned char *buf,
+                           size_t len);
+ssize_t fulldfa_exec(const fulldfa *f, char *input);
+
+// stream.c
+typedef struct stream stream;
+enum streamstate {
+  StreamMore, StreamMatch, StreamFail
+};
+stream *newstream(const program *p, bool anchored);
+void free_stream(stream *st);
+void stream_reset(stream *st);
+enum streamstate stream_feed(stream *st, const unsigned char *buf, size_t len);
+enum streamstate stream_end(stream *st);
+ssize_t stream_result(const stream *st, size_t *start, size_t **saved);
+
+// set.c
+typedef struct regexset regexset;
+regexset *newregexset(char **regexes, size_t n);
+void free_regexset(regexset *rs);
+size_t regexset_size(const regexset *rs);
+size_t regexset_match(regexset *rs, const unsigned char *buf, size_t len,
+                      bool anchored, size_t *ids);
+
+// batch.c
+/**
+   @brief Where match_batch() puts its results.
+
+   Each array is filled in if it isn't NULL.  Spans are relative to the start of
+   each row.
+ */
+typedef struct batchresult batchresult;
+struct batchresult {
+  unsigned char *bitmap; // bit i%8 of byte i/8 is set if row i matched
+  size_t *selection;     // indices of the rows which matched, in order
+  size_t *starts;        // start of each row's match (0 if none)
+  ssize_t *ends;         // end of each row's match, or -1 if none
+};
+size_t match_batch(const program *p, scratch *s, const unsigned char *data,
+                   const size_t *offsets, size_t nrows, bool anchored,
+                   batchresult *out);
+
+// jit.c
+bool jit_compile(program *p);
+
 #define nelem(x) (sizeof(x)/sizeof((x)[0]))
 
 #endif // SMB_PIKE_REGEX_H
@@ -6,7 +6,7 @@
 
   @date         Created Friday, 29 January 2016
 
-  @brief        Private lex/parse/codegen declarations.
+  @brief        Private declarations shared between modules.
 
   @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
                 BSD License.  See LICENSE.txt for details.
@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "regex.h"
 
 /**
@@ -25,7 +26,7 @@
  */
 enum TSym {
   CharSym, Special, Eof, LParen, RParen, LBracket, RBracket, Plus, Minus,
-  Star, Question, Caret, Pipe, Dot
+  Star, Question, Caret, Pipe, Dot, Counted, Dollar
 };
 typedef enum TSym TSym;
 
@@ -58,6 +59,19 @@ struct Token {
   char c;
 };
 
+/*
+  Limits on counted repetition.  Each is a compile time setting, which may be
+  overridden with -D.  A repetition is expanded into copies of what it repeats,
+  so REGEX_MAX_UNROLL bounds how many instructions one repetition may become.
+ */
+#define REPEAT_INF ((unsigned) -1)
+#ifndef REGEX_MAX_REPEAT
+#define REGEX_MAX_REPEAT 1000
+#endif
+#ifndef REGEX_MAX_UNROLL
+#define REGEX_MAX_UNROLL 65536
+#endif
+
 /**
    @brief Tree data structure to store information parsed out of a regex.
  */
@@ -68,6 +82,7 @@ struct PTree {
 
   NTSym nt;
   Token tok;
+  unsigned min, max; // bounds of a Counted terminal (max may be REPEAT_INF)
 
   struct PTree *children[4];
 };
@@ -83,6 +98,8 @@ struct Lexer {
   Token tok, prev;
   Token buf[LEXER_BUFSIZE];
   size_t nbuf;
+  unsigned min, max; // bounds of the last Counted token
+  bool inclass;      // whether the last bracket lexed was a [
 };
 
 /* Lexing */
@@ -90,6 +107,9 @@ void escape(Lexer *l);
 Token nextsym(Lexer *l);
 void unget(Token t, Lexer *l);
 instr *codegen(PTree *tree, size_t *n);
+instr *codegen_set(PTree **trees, size_t ntrees, size_t *n);
+instr *codegen_reverse(PTree *tree, size_t *n);
+instr *optimize(instr *code, size_t *n);
 
 /* Parsing */
 bool accept(TSym s, Lexer *l);
@@ -101,6 +121,180 @@ PTree *CLASS(Lexer *l);
 PTree *SUB(Lexer *l);
 PTree *reparse(char *regex);
 
+/**
+   @brief Sparse set of instruction indices.
+
+   This is the set representation from Briggs and Torczon, "An Efficient
+   Representation for Sparse Sets".  Insertion, membership testing, and clearing
+   are all constant time, and clearing doesn't need to touch the whole set.  The
+   matching engines use it to remember which instructions they have already
+   visited while following Jump, Split and Save instructions.
+ */
+typedef struct sparse_set sparse_set;
+struct sparse_set {
+  size_t *dense;
+  size_t *sparse;
+  size_t n;
+};
+
+/* Sparse sets */
+void ss_init(sparse_set *ss, size_t n);
+void ss_free(sparse_set *ss);
+void ss_clear(sparse_set *ss);
+bool ss_contains(sparse_set *ss, size_t i);
+void ss_insert(sparse_set *ss, size_t i);
+
+/* Character sets */
+#define CHARSET_BYTES 32
+unsigned char *newcharset(void);
+void free_charset(unsigned char *set);
+void charset_add(unsigned char *set, unsigned char lo, unsigned char hi);
+bool charset_has(const unsigned char *set, unsigned char c);
+unsigned char *charset_special(char type);
+
+/* Packed code */
+pprog *pack(const instr *code, size_t n);
+void free_pprog(pprog *pp);
+bool paccepts(const pprog *pp, const pinstr *pc, unsigned char c);
+
+/* Instruction evaluation */
+bool range(instr in, unsigned char test);
+bool accepts(const instr *pc, unsigned char c);
+
+/* Programs */
+void init_program(program *p, instr *code, size_t n);
+void cleanup_program(program *p);
+
+/* Pike VM */
+typedef struct bitstate bitstate;
+typedef struct jitstate jitstate;
+typedef struct thread thread;
+struct thread {
+  pinstr *pc;
+  uint32_t *saved; // this thread's row of the capture matrix
+};
+
+/**
+   @brief List of threads, along with a matrix of their captures.
+
+   Thread t[i] owns row i of the capture matrix, which is nsave + 1 slots wide
+   (the extra slot holds the index where the thread's match started).  The
+   matrix is allocated once (with room for one thread per instruction) and
+   reused for every step, so capture tracking never allocates.  Captures are
+   stored as 32-bit string indices to keep rows compact.
+ */
+typedef struct thread_list thread_list;
+struct thread_list {
+  thread *t;
+  uint32_t *caps;
+  size_t n;
+};
+
+/**
+   @brief Entry on the addthread() work stack.
+
+   Either an instruction which still needs to be explored, or (when pc is NULL)
+   a capture slot which must be restored to a previous value.
+ */
+typedef struct job job;
+struct job {
+  pinstr *pc;
+  size_t slot;
+  uint32_t value;
+};
+
+/**
+   @brief Per-match working memory (see newscratch()).
+ */
+struct scratch {
+  size_t proglen;
+  size_t nsave;
+  size_t nslot;      // width of a capture row: nsave, plus the match start
+  thread_list curr, next;
+  sparse_set visited; // instructions visited at the current string index
+  job *stack;        // work stack for addthread()
+  uint32_t *work;    // initial captures for new threads
+  uint32_t *matched; // captures of the last thread to match
+  bitstate *bt;      // for backtracking on short inputs
+  unsigned ctx;      // assertions which hold where addthread() is working
+  uint32_t unset;    // value of capture slots a new thread hasn't set
+  jitstate *js;      // for native code (allocated on first use)
+};
+
+void addthread(const program *p, scratch *s, thread_list *threads,
+               pinstr *pc, uint32_t *saved, size_t sp);
+void pike_begin(const program *p, scratch *s, size_t sp, unsigned ctx);
+void pike_step(const program *p, scratch *s, int c, int next, size_t sp,
+               bool inject, ssize_t *match);
+ssize_t pikevm(const program *p, scratch *s, const unsigned char *buf,
+               size_t len, bool anchored, size_t *start, size_t **saved);
+ssize_t pike_window(const program *p, scratch *s, const unsigned char *buf,
+                    size_t len, size_t from, size_t to, size_t *start,
+                    size_t **saved, size_t *stop);
+
+/* Backtracking */
+bitstate *newbitstate(const program *p);
+void free_bitstate(bitstate *b);
+bool backtrack_fits(size_t proglen, size_t len);
+ssize_t backtrack(const program *p, bitstate *b, const unsigned char *buf,
+                  size_t len, bool anchored, uint32_t *matched);
+
+/* Native code */
+bool jit_fits(size_t proglen, size_t len);
+ssize_t jit_exec(const program *p, scratch *s, const unsigned char *buf,
+                 size_t len, bool anchored);
+void free_jit(jitcode *j);
+void free_jitstate(jitstate *js);
+
+/* Lazy DFA states (for building full DFAs) */
+/*
+  Smallest number of states a DFA allows: a state, and the one it transitions
+  to.  newdfa() raises smaller limits to this.
+ */
+#define DFA_MINSTATES 2
+typedef struct dstate dstate;
+dstate *dfa_start(dfa *d, bool anchored);
+dstate *dfa_next(dfa *d, dstate *st, unsigned char c);
+size_t dfa_stateid(const dstate *st);
+bool dfa_accepting(const dstate *st);
+bool dfa_dead(const dstate *st);
+
+/* One-pass matching */
+onepass *onepass_compile(const program *p);
+ssize_t onepass_exec(const onepass *op, const unsigned char *buf, size_t len,
+                     uint32_t *caps, uint32_t *matched);
+void free_onepass(onepass *op);
+
+/* Prefilters */
+prefilter *prefilter_compile(const program *p);
+prefilter *prefilter_literal(const unsigned char *lit, size_t n);
+void free_prefilter(prefilter *pf);
+bool prefilter_first(const prefilter *pf, unsigned char c);
+size_t prefilter_next(const prefilter *pf, const unsigned char *buf,
+                      size_t len, size_t sp);
+
+/* Streams */
+void stream_rebase_at(stream *st, size_t at);
+
+/* Assertions and anchors */
+unsigned lookaround(int prev, int next);
+unsigned lookaround_at(const unsigned char *buf, size_t len, size_t sp);
+void anchor_compile(program *p);
+bool anchor_allows(const program *p, const unsigned char *buf, size_t sp);
+size_t anchor_next(const program *p, const prefilter *pf,
+                   const unsigned char *buf, size_t len, size_t sp);
+
+/* Reverse scanning */
+size_t reverse_scan(const pprog *rev, scratch *s, const unsigned char *buf,
+                    size_t len, size_t lo, size_t end);
+
+/* Inner literals */
+inner *inner_compile(PTree *tree);
+void free_inner(inner *in);
+size_t inner_size(const inner *in);
+ssize_t inner_search(const program *p, scratch *s, const unsigned char *buf,
+                     size_t len, size_t *start, size_t **saved);
+
 /* Utitlites */
 void free_tree(PTree *tree);
 char *char_to_string(char c);
@@ -0,0 +1,126 @@
+/***************************************************************************//**
+
+  @file         reverse.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Running reversed code backwards, to find where matches begin.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on reverse scanning:
+
+  A DFA (or a literal search) can cheaply tell where a match ends, but not where
+  it begins.  codegen_reverse() generates code for the same regex with every
+  concatenation flipped, which matches exactly the reverse of each string the
+  regex matches.  Running that code backwards from the end of a match, the
+  earliest index at which it reaches a Match is where the match begins.
+
+  Since we want the earliest start, not the preferred one, thread priority
+  doesn't matter.  A thread list is just a list of instructions, and a Match
+  doesn't cut off any other threads.  There are no Save instructions, so the
+  Pike VM's scratch can be reused as working space (newscratch() makes sure it
+  is big enough for the program's reversed code as well).
+
+  An Assert is left as it is, since it holds at the same index whichever way
+  the string is read.  So it is checked against the bytes around that index in
+  the whole buffer, not just the part being scanned.
+
+*******************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+/**
+   @brief Add the epsilon closure of a reversed instruction to a thread list.
+
+   Only the instruction of each thread is used.  An Assert is followed if its
+   condition is in s->ctx.
+ */
+static void closure(const pprog *rev, scratch *s, thread_list *tl, pinstr *pc)
+{
+  size_t njob = 0;
+  s->stack[njob++] = (job){pc, 0, 0};
+
+  while (njob > 0) {
+    pc = s->stack[--njob].pc;
+    while (pc != NULL) {
+      size_t idx = pc - rev->code;
+      if (ss_contains(&s->visited, idx)) {
+        break;
+      }
+      ss_insert(&s->visited, idx);
+
+      switch (pc->op) {
+      case Jump:
+        pc += pc->x;
+        break;
+      case Split:
+        s->stack[njob++] = (job){pc + pc->y, 0, 0};
+        pc += pc->x;
+        break;
+      case Assert:
+        pc = (s->ctx & pc->x) ? pc + 1 : NULL;
+        break;
+      default:
+        tl->t[tl->n++].pc = pc;
+        pc = NULL;
+        break;
+      }
+    }
+  }
+}
+
+/**
+   @brief Find the earliest index from which reversed code matches up to end.
+   @param rev Code generated by codegen_reverse(), packed.
+   @param s Scratch for a program at least as long as rev.
+   @param buf Bytes to scan.
+   @param len Number of bytes in buf (for assertions).
+   @param lo Earliest index to consider.
+   @param end Index to scan backwards from.
+   @returns The smallest index in [lo, end] from which the regex matches exactly
+   up to end, or end + 1 if there is none.
+ */
+size_t reverse_scan(const pprog *rev, scratch *s, const unsigned char *buf,
+                    size_t len, size_t lo, size_t end)
+{
+  size_t found = end + 1;
+  size_t sp = end;
+
+  assert(rev->n <= s->proglen);
+  ss_clear(&s->visited);
+  s->ctx = lookaround_at(buf, len, end);
+  s->curr.n = 0;
+  closure(rev, s, &s->curr, rev->code);
+
+  while (s->curr.n > 0) {
+    ss_clear(&s->visited);
+    s->ctx = sp > 0 ? lookaround_at(buf, len, sp - 1) : 0;
+    s->next.n = 0;
+    for (size_t t = 0; t < s->curr.n; t++) {
+      pinstr *pc = s->curr.t[t].pc;
+      if (pc->op == Match) {
+        found = sp;
+      } else if (sp > lo && paccepts(rev, pc, buf[sp - 1])) {
+        closure(rev, s, &s->next, pc + 1);
+      }
+    }
+    if (sp == lo) {
+      break;
+    }
+    thread_list temp = s->curr;
+    s->curr = s->next;
+    s->next = temp;
+    sp--;
+  }
+  return found;
+}
@@ -0,0 +1,199 @@
+/***************************************************************************//**
+
+  @file         set.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Matching many regexes at once.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on regex sets:
+
+  Running each of a large number of regexes over the same input reads the input
+  once per regex.  Instead, a set compiles all of them into one program (see
+  codegen_set()), in which each match instruction carries the index of its
+  regex, and simulates that program once.
+
+  Unlike the Pike VM, a set doesn't stop at the first match: we want to know
+  every regex that matches, not which one is preferred.  So there is no thread
+  priority and there are no captures, and a thread list is just a set of
+  instructions.  When a thread reaches a match instruction, its regex is
+  recorded, and the other threads carry on.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+struct regexset {
+  program p;
+  size_t nregex;
+  sparse_set curr, next; // instructions reached at the current/next index
+  instr **stack;         // work stack for closure()
+  bool *matched;         // which regexes have matched so far
+};
+
+/**
+   @brief Compile a set of regexes.
+
+   Like a scratch, a set holds state which is modified while matching, so it may
+   only be used by one thread at a time.
+   @param regexes Array of regexes.
+   @param n Number of regexes (at least one).
+ */
+regexset *newregexset(char **regexes, size_t n)
+{
+  regexset *rs = calloc(1, sizeof(regexset));
+  size_t ninstr;
+  instr *code = recomp_set(regexes, n, &ninstr);
+  rs->p = (program){.code = code, .n = ninstr,
+                    .nsave = numsaves(code, ninstr)};
+  rs->nregex = n;
+  ss_init(&rs->curr, ninstr);
+  ss_init(&rs->next, ninstr);
+  rs->stack = calloc(ninstr + 1, sizeof(instr *));
+  rs->matched = calloc(n, sizeof(bool));
+  return rs;
+}
+
+void free_regexset(regexset *rs)
+{
+  free_prog(rs->p.code, rs->p.n);
+  ss_free(&rs->curr);
+  ss_free(&rs->next);
+  free(rs->stack);
+  free(rs->matched);
+  free(rs);
+}
+
+/**
+   @brief Return the number of regexes in a set.
+ */
+size_t regexset_size(const regexset *rs)
+{
+  return rs->nregex;
+}
+
+/**
+   @brief Add the epsilon closure of an instruction to a set.
+
+   Jump, Split, Save and Assert instructions are added too, which marks them
+   visited.  They are skipped when the set is stepped.
+   @param ctx Assertions which hold at this index (see lookaround()).
+ */
+static void closure(regexset *rs, sparse_set *set, instr *pc, unsigned ctx)
+{
+  size_t nstack = 0;
+  rs->stack[nstack++] = pc;
+
+  while (nstack > 0) {
+    pc = rs->stack[--nstack];
+    while (pc != NULL) {
+      size_t idx = pc - rs->p.code;
+      if (ss_contains(set, idx)) {
+        break;
+      }
+      ss_insert(set, idx);
+
+      switch (pc->code) {
+      case Jump:
+        pc = pc->x;
+        break;
+      case Split:
+        rs->stack[nstack++] = pc->y;
+        pc = pc->x;
+        break;
+      case Save:
+        pc = pc + 1;
+        break;
+      case Assert:
+        pc = (ctx & pc->s) ? pc + 1 : NULL;
+        break;
+      default:
+        pc = NULL;
+        break;
+      }
+    }
+  }
+}
+
+/**
+   @brief Find every regex in a set which matches a buffer.
+
+   This reads the input once, no matter how many regexes are in the set.  It
+   stops early once every regex has matched (or, when anchored, once no thread
+   is left).
+   @param rs Set to match.
+   @param buf Bytes to match.
+   @param len Number of bytes in buf.
+   @param anchored Whether matches must begin at the start of the buffer.
+   Otherwise, a regex matches if it matches anywhere in the buffer.
+   @param[out] ids Where to put the indices of the regexes which matched, in
+   increasing order (must have room for regexset_size() entries).
+   @returns The number of regexes which matched.
+ */
+size_t regexset_match(regexset *rs, const unsigned char *buf, size_t len,
+                      bool anchored, size_t *ids)
+{
+  size_t nmatched = 0;
+  memset(rs->matched, 0, rs->nregex * sizeof(bool));
+  ss_clear(&rs->curr);
+  closure(rs, &rs->curr, rs->p.code, lookaround_at(buf, len, 0));
+
+  for (size_t sp = 0; sp <= len; sp++) {
+    unsigned ctx = lookaround_at(buf, len, sp + 1);
+    ss_clear(&rs->next);
+    for (size_t i = 0; i < rs->curr.n; i++) {
+      instr *pc = rs->p.code + rs->curr.dense[i];
+      switch (pc->code) {
+      case Match:
+        if (!rs->matched[pc->s]) {
+          rs->matched[pc->s] = true;
+          nmatched++;
+        }
+        break;
+      case Char:
+      case String:
+      case Any:
+      case Range:
+      case NRange:
+        if (sp < len && accepts(pc, buf[sp])) {
+          closure(rs, &rs->next, pc + 1, ctx);
+        }
+        break;
+      default:
+        break;
+      }
+    }
+
+    if (nmatched == rs->nregex || sp == len) {
+      break;
+    }
+    if (!anchored) {
+      closure(rs, &rs->next, rs->p.code, ctx);
+    } else if (rs->next.n == 0) {
+      break;
+    }
+
+    sparse_set temp = rs->curr;
+    rs->curr = rs->next;
+    rs->next = temp;
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < rs->nregex; i++) {
+    if (rs->matched[i]) {
+      ids[n++] = i;
+    }
+  }
+  return n;
+}
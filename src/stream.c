@@ -0,0 +1,287 @@
+/***************************************************************************//**
+
+  @file         stream.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Matching input that arrives in chunks.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+  Notes on streaming:
+
+  The Pike VM only ever looks at one byte of input at a time, and everything it
+  remembers about the input so far is in its thread list.  So, rather than
+  joining chunks together, a stream keeps the VM's scratch between calls to
+  stream_feed(), and steps the VM over each chunk as it arrives.  No input is
+  buffered, so memory use depends only on the program.
+
+  A match is decided as soon as the highest priority thread reaches a Match,
+  since that cuts off every other thread.  At that point the stream stops and
+  reports the match, even in the middle of a chunk.
+
+  An Assert for the end of a line or of the text depends on the byte after the
+  index where it is checked.  For programs with one, the stream holds on to the
+  last byte it was fed, and only steps the VM over it once the next byte (or
+  the end of the stream) has arrived.
+
+  The VM stores string indices in 32 bits.  To report offsets in a stream of any
+  length, indices are kept relative to a base offset, which is moved forward
+  (and the captures of every live thread adjusted) when indices grow large.
+
+*******************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "regex.h"
+#include "regparse.h"
+
+/*
+  Relative index at which the base offset is moved forward.  This can be
+  lowered at build time (or for one stream, with stream_rebase_at()) to test
+  rebasing.
+ */
+#ifndef STREAM_REBASE
+#define STREAM_REBASE ((size_t) UINT32_MAX / 2)
+#endif
+
+/*
+  Value of a capture slot which hasn't been set.  Unlike 0, it is left alone
+  when the base offset moves, and is reported as 0 like run() does.
+ */
+#define UNSET UINT32_MAX
+
+struct stream {
+  const program *p;
+  scratch *s;
+  bool anchored;
+  bool lookahead;     // whether the VM needs the byte after each one it steps
+  bool begun;         // whether the VM has been started
+  int held;           // last byte fed, when it hasn't been stepped over (or -1)
+  size_t base;        // stream offset of VM string index 0
+  size_t pos;         // stream offset of the next byte to be fed
+  size_t rebase;      // relative index at which the base is moved forward
+  ssize_t match;      // VM string index of the end of the match, or -1
+  enum streamstate state;
+};
+
+/**
+   @brief Decide the stream, if it can be decided now.
+
+   The VM can report a match once the highest priority thread reaches it.
+   Otherwise, the stream is decided when no threads are left (unless a thread
+   started later could still get past an Assert where the others died).
+ */
+static void decide(stream *st)
+{
+  scratch *s = st->s;
+  if (s->curr.n > 0 && s->curr.t[0].pc->op == Match) {
+    memcpy(s->matched, s->curr.t[0].saved, s->nslot * sizeof(uint32_t));
+    st->match = st->pos - st->base;
+    s->curr.n = 0;
+  }
+  if (s->curr.n == 0 &&
+      (st->match != -1 || st->anchored || !st->p->assertions)) {
+    st->state = (st->match == -1) ? StreamFail : StreamMatch;
+  }
+}
+
+/**
+   @brief Start the VM at offset 0.
+   @param next The first byte of the stream, or -1 if there is none (or it
+   isn't needed).
+ */
+static void begin(stream *st, int next)
+{
+  pike_begin(st->p, st->s, 0, lookaround(-1, next));
+  st->begun = true;
+  decide(st);
+}
+
+/**
+   @brief Begin matching a new stream, at offset 0.
+ */
+void stream_reset(stream *st)
+{
+  st->base = 0;
+  st->pos = 0;
+  st->match = -1;
+  st->state = StreamMore;
+  st->held = -1;
+  st->begun = false;
+  if (!st->lookahead) {
+    begin(st, -1);
+  }
+}
+
+/**
+   @brief Create a stream for matching a program against chunked input.
+
+   Like a scratch, a stream may only be used by one thread at a time.  The
+   program is not copied, so it must outlive the stream.
+   @param p Program to match.
+   @param anchored Whether the match must begin at the start of the stream.
+ */
+stream *newstream(const program *p, bool anchored)
+{
+  stream *st = calloc(1, sizeof(stream));
+  st->p = p;
+  st->s = newscratch(p);
+  st->s->unset = UNSET;
+  st->anchored = anchored;
+  st->rebase = STREAM_REBASE;
+  st->lookahead = p->assertions & (EndText | EndLine);
+  stream_reset(st);
+  return st;
+}
+
+void free_stream(stream *st)
+{
+  free_scratch(st->s);
+  free(st);
+}
+
+/**
+   @brief Set the relative index at which a stream moves its base offset.
+ */
+void stream_rebase_at(stream *st, size_t at)
+{
+  st->rebase = at;
+}
+
+/**
+   @brief Move the base offset up to the start of the earliest live thread.
+
+   Every capture a live thread has set is at or after its start, so those stay
+   correct.  Slots which were never set hold UNSET, which is left alone.
+ */
+static void rebase(stream *st)
+{
+  scratch *s = st->s;
+  uint32_t delta = st->pos - st->base;
+  for (size_t t = 0; t < s->curr.n; t++) {
+    if (s->curr.t[t].saved[s->nsave] < delta) {
+      delta = s->curr.t[t].saved[s->nsave];
+    }
+  }
+  if (st->match != -1 && s->matched[s->nsave] < delta) {
+    delta = s->matched[s->nsave];
+  }
+
+  for (size_t t = 0; t < s->curr.n; t++) {
+    uint32_t *saved = s->curr.t[t].saved;
+    for (size_t i = 0; i < s->nslot; i++) {
+      if (saved[i] != UNSET) {
+        saved[i] -= delta;
+      }
+    }
+  }
+  if (st->match != -1) {
+    for (size_t i = 0; i < s->nslot; i++) {
+      if (s->matched[i] != UNSET) {
+        s->matched[i] -= delta;
+      }
+    }
+    st->match -= delta;
+  }
+  st->base += delta;
+}
+
+/**
+   @brief Step the VM over a byte.
+   @param next The byte after it, or -1 if it isn't known (or needed).
+ */
+static void step(stream *st, unsigned char c, int next)
+{
+  if (st->pos - st->base >= st->rebase) {
+    rebase(st);
+    // A single match attempt may not span 4GiB.
+    assert(st->pos - st->base < UINT32_MAX);
+  }
+  pike_step(st->p, st->s, c, next, st->pos - st->base, !st->anchored,
+            &st->match);
+  st->pos++;
+  decide(st);
+}
+
+/**
+   @brief Feed the next chunk of input to a stream.
+
+   Bytes after the point where the stream is decided are ignored.
+   @param st Stream to feed.
+   @param buf Next bytes of the stream.
+   @param len Number of bytes in buf.
+   @returns StreamMore if more input (or stream_end()) is needed to decide the
+   match, otherwise StreamMatch or StreamFail.
+ */
+enum streamstate stream_feed(stream *st, const unsigned char *buf, size_t len)
+{
+  for (size_t i = 0; i < len && st->state == StreamMore; i++) {
+    if (!st->lookahead) {
+      step(st, buf[i], -1);
+    } else if (!st->begun) {
+      begin(st, buf[i]);
+      st->held = buf[i];
+    } else {
+      step(st, st->held, buf[i]);
+      st->held = buf[i];
+    }
+  }
+  return st->state;
+}
+
+/**
+   @brief Tell a stream that there is no more input.
+   @returns StreamMatch or StreamFail.
+ */
+enum streamstate stream_end(stream *st)
+{
+  if (st->state == StreamMore && !st->begun) {
+    begin(st, -1);
+  }
+  if (st->state == StreamMore && st->held != -1) {
+    step(st, st->held, -1);
+    st->held = -1;
+  }
+  if (st->state == StreamMore) {
+    pike_step(st->p, st->s, -1, -1, st->pos - st->base, false, &st->match);
+    st->state = (st->match == -1) ? StreamFail : StreamMatch;
+  }
+  return st->state;
+}
+
+/**
+   @brief Return the match found by a stream, in stream offsets.
+   @param st Stream which has been decided.
+   @param[out] start Where to put the start offset of the match (may be NULL).
+   @param[out] saved Where to put the capture list (may be NULL).
+   @returns Offset of the end of the match, or -1 if there is no match.
+ */
+ssize_t stream_result(const stream *st, size_t *start, size_t **saved)
+{
+  scratch *s = st->s;
+  if (saved) {
+    *saved = NULL;
+  }
+  if (st->match == -1) {
+    return -1;
+  }
+
+  if (start) {
+    *start = st->base + s->matched[s->nsave];
+  }
+  if (saved) {
+    *saved = calloc(st->p->nsave, sizeof(size_t));
+    for (size_t i = 0; i < st->p->nsave; i++) {
+      (*saved)[i] = s->matched[i] == UNSET ? 0 : st->base + s->matched[i];
+    }
+  }
+  return st->base + st->match;
+}
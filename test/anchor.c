@@ -0,0 +1,210 @@
+/***************************************************************************//**
+
+  @file         anchor.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Assertion and anchor tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+static int test_lookaround(void)
+{
+  const unsigned char *buf = (const unsigned char *) "a\nb";
+
+  TEST_ASSERT(lookaround_at(buf, 3, 0) == (BeginText | BeginLine));
+  TEST_ASSERT(lookaround_at(buf, 3, 1) == EndLine);
+  TEST_ASSERT(lookaround_at(buf, 3, 2) == BeginLine);
+  TEST_ASSERT(lookaround_at(buf, 3, 3) == (EndText | EndLine));
+  TEST_ASSERT(lookaround_at(buf, 0, 0) ==
+              (BeginText | BeginLine | EndText | EndLine));
+  return 0;
+}
+
+static int test_codegen(void)
+{
+  size_t n;
+  instr *prog = recomp("^a$\\A\\z", &n);
+
+  TEST_ASSERT(n == 6);
+  TEST_ASSERT(prog[0].code == Assert && prog[0].s == BeginLine);
+  TEST_ASSERT(prog[1].code == Char && prog[1].c == 'a');
+  TEST_ASSERT(prog[2].code == Assert && prog[2].s == EndLine);
+  TEST_ASSERT(prog[3].code == Assert && prog[3].s == BeginText);
+  TEST_ASSERT(prog[4].code == Assert && prog[4].s == EndText);
+  TEST_ASSERT(prog[5].code == Match);
+  free_prog(prog, n);
+
+  // Inside a class, or escaped, they are just characters.
+  prog = recomp("[$]\\^\\$", &n);
+  TEST_ASSERT(n == 4);
+  TEST_ASSERT(prog[0].code == Range);
+  TEST_ASSERT(charset_has((unsigned char *) prog[0].x, '$'));
+  TEST_ASSERT(prog[1].code == String && prog[1].s == 2);
+  TEST_ASSERT(memcmp(prog[1].x, "^$", 2) == 0);
+  free_prog(prog, n);
+
+  char text[] = "assert end-text\nmatch\n";
+  prog = read_prog(text, &n);
+  TEST_ASSERT(n == 2);
+  TEST_ASSERT(prog[0].code == Assert && prog[0].s == EndText);
+  free_prog(prog, n);
+  return 0;
+}
+
+static int test_anchors(void)
+{
+  struct {
+    char *regex;
+    unsigned anchors;
+  } cases[] = {
+    {"\\Aab", BeginText}, {"(\\Aa)*b", 0}, {"^a|^b", BeginLine},
+    {"^a|\\Ab", BeginLine}, {"^a|b", 0}, {"a^", 0}, {"a\\z", EndText},
+    {"(a\\z|b\\z)", EndText}, {"a\\z|b", 0}, {"a$", 0},
+    {"\\A(a|b)*\\z", BeginText | EndText}, {"a", 0},
+  };
+
+  for (size_t i = 0; i < nelem(cases); i++) {
+    program *p = compile(cases[i].regex);
+    TEST_ASSERT(p->anchors == cases[i].anchors);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  Every engine must find the same leftmost match.
+ */
+static int test_search(void)
+{
+  struct {
+    char *regex;
+    char *input;
+    ssize_t start, end;
+  } cases[] = {
+    {"^abc", "abc", 0, 3}, {"^abc", "xabc", -1, -1},
+    {"^abc", "x\nabc", 2, 5}, {"\\Aabc", "x\nabc", -1, -1},
+    {"\\Aabc", "abc\n", 0, 3}, {"abc$", "abc\nx", 0, 3},
+    {"abc$", "abcx", -1, -1}, {"abc\\z", "abc\nabc", 4, 7},
+    {"abc\\z", "abc\n", -1, -1}, {"^$", "a\n\nb", 2, 2},
+    {"$\\n", "ab\n", 2, 3}, {"^", "", 0, 0}, {"\\z", "ab", 2, 2},
+    {"a*$", "aab", 3, 3}, {"^\\w+$", "foo bar\nbaz", 8, 11},
+    {"(a|^b)+", "cbab", 2, 3}, {"(\\w+)\\z", "ab cd", 3, 5},
+  };
+
+  for (size_t i = 0; i < nelem(cases); i++) {
+    program *p = compile(cases[i].regex);
+    scratch *s = newscratch(p);
+    const unsigned char *buf = (const unsigned char *) cases[i].input;
+    size_t len = strlen(cases[i].input);
+    size_t start, *saved;
+    uint32_t *matched = calloc(p->nsave + 1, sizeof(uint32_t));
+
+    TEST_ASSERT(search_bytes(p, s, buf, len, &start, NULL) == cases[i].end);
+    TEST_ASSERT(cases[i].end == -1 || (ssize_t) start == cases[i].start);
+    TEST_ASSERT(search_bytes(p, s, buf, len, &start, &saved) == cases[i].end);
+    TEST_ASSERT(cases[i].end == -1 || (ssize_t) start == cases[i].start);
+    free(saved);
+    TEST_ASSERT(pikevm(p, s, buf, len, false, &start, NULL) == cases[i].end);
+    TEST_ASSERT(cases[i].end == -1 || (ssize_t) start == cases[i].start);
+    TEST_ASSERT(backtrack(p, s->bt, buf, len, false, matched) ==
+                cases[i].end);
+    TEST_ASSERT(is_match(p, s, buf, len, false) == (cases[i].end != -1));
+
+    // One byte at a time, so the stream has to hold each byte back.
+    stream *st = newstream(p, false);
+    for (size_t j = 0; j < len; j++) {
+      stream_feed(st, buf + j, 1);
+    }
+    stream_end(st);
+    TEST_ASSERT(stream_result(st, &start, NULL) == cases[i].end);
+    TEST_ASSERT(cases[i].end == -1 || (ssize_t) start == cases[i].start);
+    free_stream(st);
+
+    dfa *d = newdfa(p, 16);
+    TEST_ASSERT(dfa_search_bytes(d, buf, len, &start, NULL) == cases[i].end);
+    free_dfa(d);
+
+    regexset *rs = newregexset(&cases[i].regex, 1);
+    size_t id;
+    TEST_ASSERT(regexset_match(rs, buf, len, false, &id) ==
+                (cases[i].end != -1));
+    free_regexset(rs);
+
+    free(matched);
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  On long inputs, only line starts are tried, and the VM skips between them.
+ */
+static int test_long(void)
+{
+  size_t len = 100000;
+  unsigned char *buf = malloc(len);
+  memset(buf, 'a', len);
+  buf[len - 5] = '\n';
+  memcpy(buf + len - 4, "abc\n", 4);
+
+  program *p = compile("^abc$");
+  scratch *s = newscratch(p);
+  size_t start;
+  TEST_ASSERT(search_bytes(p, s, buf, len, &start, NULL) == (ssize_t) len - 1);
+  TEST_ASSERT(start == len - 4);
+  TEST_ASSERT(is_match(p, s, buf, len, false));
+  TEST_ASSERT(!is_match(p, s, buf, len - 6, false));
+  free_scratch(s);
+  free_program(p);
+
+  p = compile("(a|b)\\z");
+  s = newscratch(p);
+  TEST_ASSERT(search_bytes(p, s, buf, len - 6, &start, NULL) ==
+              (ssize_t) len - 6);
+  TEST_ASSERT(start == len - 7);
+  TEST_ASSERT(search_bytes(p, s, buf, len, &start, NULL) == -1);
+  free_scratch(s);
+  free_program(p);
+
+  free(buf);
+  return 0;
+}
+
+void anchor_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/anchor.c");
+
+  smb_ut_test *lookaround = su_create_test("lookaround", test_lookaround);
+  su_add_test(group, lookaround);
+
+  smb_ut_test *codegen = su_create_test("codegen", test_codegen);
+  su_add_test(group, codegen);
+
+  smb_ut_test *anchors = su_create_test("anchors", test_anchors);
+  su_add_test(group, anchors);
+
+  smb_ut_test *search = su_create_test("search", test_search);
+  su_add_test(group, search);
+
+  smb_ut_test *long_input = su_create_test("long", test_long);
+  su_add_test(group, long_input);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
@@ -0,0 +1,92 @@
+/***************************************************************************//**
+
+  @file         backtrack.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Bounded backtracking tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+/*
+  The backtracker must find the same match, start, and captures as the Pike VM,
+  both anchored and unanchored.
+ */
+static int test_agrees(void)
+{
+  char *regexes[] = {
+    "(a*)b", "(a|ab)(c|bcd)(d*)", "(a*)*b", "(a*?)(a*)", "((a)|(b))*c",
+    "(a|b)*a(a|b)", "x*", "(\\w+)@(\\w+)", "(abc|abd)(de)*f",
+  };
+  char *inputs[] = {
+    "", "b", "aab", "abcd", "abcdd", "xxabcdx", "aaac", "ababc", "bba",
+    "aaaa", "me@host", "x@", "xxx", "abdedef", "xabcf", "abcdedf", "abcd",
+  };
+
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    scratch *s = newscratch(p);
+    bitstate *b = newbitstate(p);
+    uint32_t *matched = calloc(p->nsave + 1, sizeof(uint32_t));
+
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      size_t len = strlen(inputs[j]);
+      for (int anchored = 0; anchored < 2; anchored++) {
+        size_t *capture, start;
+        unsigned char *buf = (unsigned char *) inputs[j];
+        ssize_t m1 = backtrack(p, b, buf, len, anchored, matched);
+        ssize_t m2 = pikevm(p, s, buf, len, anchored, &start, &capture);
+        TEST_ASSERT(m1 == m2);
+        if (m2 != -1) {
+          TEST_ASSERT(matched[p->nsave] == start);
+          for (size_t k = 0; k < p->nsave; k++) {
+            TEST_ASSERT(matched[k] == capture[k]);
+          }
+          free(capture);
+        }
+      }
+    }
+
+    free(matched);
+    free_bitstate(b);
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+static int test_fits(void)
+{
+  TEST_ASSERT(backtrack_fits(10, 3));
+  TEST_ASSERT(backtrack_fits(10, 0));
+  TEST_ASSERT(backtrack_fits(10, 4095));
+  TEST_ASSERT(!backtrack_fits(1000, 4095));
+  return 0;
+}
+
+void backtrack_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/backtrack.c");
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  smb_ut_test *fits = su_create_test("fits", test_fits);
+  su_add_test(group, fits);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
@@ -0,0 +1,95 @@
+/***************************************************************************//**
+
+  @file         batch.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Batch matching tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+static char *rows[] = {
+  "", "a", "b", "aab", "abcd", "xxabcdx", "foo@bar", "x@y z", "cab", "zzzz",
+};
+
+/*
+  Every output must agree with calling run() or search() on each row.
+ */
+static int test_agrees(void)
+{
+  char *regexes[] = {"(a*)b", "ab|a", "\\w+@\\w+", "z*", "[c-d]+"};
+  unsigned char data[256];
+  size_t offsets[nelem(rows) + 1];
+  size_t n = nelem(rows);
+
+  // Pack the rows into a column, without terminators.
+  offsets[0] = 0;
+  for (size_t i = 0; i < n; i++) {
+    size_t len = strlen(rows[i]);
+    memcpy(data + offsets[i], rows[i], len);
+    offsets[i + 1] = offsets[i] + len;
+  }
+
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    scratch *s = newscratch(p);
+    for (int anchored = 0; anchored < 2; anchored++) {
+      unsigned char bitmap[(nelem(rows) + 7) / 8];
+      size_t selection[nelem(rows)], starts[nelem(rows)];
+      ssize_t ends[nelem(rows)];
+      batchresult res = {bitmap, selection, starts, ends};
+      batchresult bits = {bitmap, NULL, NULL, NULL};
+      size_t k = 0;
+
+      size_t nmatch = match_batch(p, s, data, offsets, n, anchored, &res);
+      for (size_t j = 0; j < n; j++) {
+        size_t start = 0;
+        ssize_t end = anchored ? run(p, s, rows[j], NULL)
+                               : search(p, s, rows[j], &start, NULL);
+        TEST_ASSERT(ends[j] == end);
+        TEST_ASSERT(!!(bitmap[j / 8] & (1 << (j % 8))) == (end != -1));
+        if (end != -1) {
+          TEST_ASSERT(starts[j] == start);
+          TEST_ASSERT(k < nmatch && selection[k] == j);
+          k++;
+        }
+      }
+      TEST_ASSERT(k == nmatch);
+
+      // Without spans, only the bitmap is filled in.
+      memset(bitmap, 0xff, sizeof(bitmap));
+      TEST_ASSERT(match_batch(p, s, data, offsets, n, anchored, &bits) ==
+                  nmatch);
+      for (size_t j = 0; j < n; j++) {
+        TEST_ASSERT(!!(bitmap[j / 8] & (1 << (j % 8))) == (ends[j] != -1));
+      }
+    }
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+void batch_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/batch.c");
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
@@ -38,54 +38,33 @@ static int test_special(void)
 {
   size_t n;
   instr *prog;
-
-  prog = recomp("\\d", &n);
-  TEST_ASSERT(n == 2);
-  TEST_ASSERT(prog[0].code == Range);
-  TEST_ASSERT(prog[0].s == 1);
-  TEST_ASSERT(0 == strncmp("09", (char*)prog[0].x, 2));
-  TEST_ASSERT(prog[1].code == Match);
-  free_prog(prog, n);
-
-  prog = recomp("\\D", &n);
-  TEST_ASSERT(n == 2);
-  TEST_ASSERT(prog[0].code == NRange);
-  TEST_ASSERT(prog[0].s == 1);
-  TEST_ASSERT(0 == strncmp("09", (char*)prog[0].x, 2));
-  TEST_ASSERT(prog[1].code == Match);
-  free_prog(prog, n);
-
-  prog = recomp("\\w", &n);
-  TEST_ASSERT(n == 2);
-  TEST_ASSERT(prog[0].code == Range);
-  TEST_ASSERT(prog[0].s == 4);
-  TEST_ASSERT(0 == strncmp("azAZ09__", (char*)prog[0].x, 8));
-  TEST_ASSERT(prog[1].code == Match);
-  free_prog(prog, n);
-
-  prog = recomp("\\W", &n);
-  TEST_ASSERT(n == 2);
-  TEST_ASSERT(prog[0].code == NRange);
-  TEST_ASSERT(prog[0].s == 4);
-  TEST_ASSERT(0 == strncmp("azAZ09__", (char*)prog[0].x, 8));
-  TEST_ASSERT(prog[1].code == Match);
-  free_prog(prog, n);
-
-  prog = recomp("\\s", &n);
-  TEST_ASSERT(n == 2);
-  TEST_ASSERT(prog[0].code == Range);
-  TEST_ASSERT(prog[0].s == 6);
-  TEST_ASSERT(0 == strncmp("  \t\t\n\n\r\r\f\f\v\v", (char*)prog[0].x, 12));
-  TEST_ASSERT(prog[1].code == Match);
-  free_prog(prog, n);
-
-  prog = recomp("\\S", &n);
-  TEST_ASSERT(n == 2);
-  TEST_ASSERT(prog[0].code == NRange);
-  TEST_ASSERT(prog[0].s == 6);
-  TEST_ASSERT(0 == strncmp("  \t\t\n\n\r\r\f\f\v\v", (char*)prog[0].x, 12));
-  TEST_ASSERT(prog[1].code == Match);
-  free_prog(prog, n);
+  char *specials = "dDwWsS";
+
+  // Each special class (and its negation) shares one static charset.
+  for (size_t i = 0; i < 6; i++) {
+    char regex[] = {'\\', specials[i], '\0'};
+    unsigned char *set = charset_special(specials[i & ~1]);
+    prog = recomp(regex, &n);
+    TEST_ASSERT(n == 2);
+    TEST_ASSERT(prog[0].code == (i % 2 == 0 ? Range : NRange));
+    TEST_ASSERT((unsigned char *) prog[0].x == set);
+    TEST_ASSERT(prog[1].code == Match);
+    free_prog(prog, n);
+  }
+
+  TEST_ASSERT(charset_has(charset_special('d'), '0'));
+  TEST_ASSERT(charset_has(charset_special('d'), '9'));
+  TEST_ASSERT(!charset_has(charset_special('d'), 'a'));
+  for (char c = 'a'; c <= 'z'; c++) {
+    TEST_ASSERT(charset_has(charset_special('w'), c));
+    TEST_ASSERT(charset_has(charset_special('w'), c - 'a' + 'A'));
+  }
+  TEST_ASSERT(charset_has(charset_special('w'), '_'));
+  TEST_ASSERT(!charset_has(charset_special('w'), '-'));
+  for (size_t i = 0; i < 6; i++) {
+    TEST_ASSERT(charset_has(charset_special('s'), " \t\n\r\f\v"[i]));
+  }
+  TEST_ASSERT(!charset_has(charset_special('s'), 'x'));
 
   return 0;
 }
@@ -202,8 +181,10 @@ static int test_concat(void)
   instr *prog = recomp("ab", &n);
 
   TEST_ASSERT(n == 3);
-  TEST_ASSERT(prog[0].code == Char);
+  TEST_ASSERT(prog[0].code == String);
   TEST_ASSERT(prog[0].c == 'a');
+  TEST_ASSERT(prog[0].s == 2);
+  TEST_ASSERT(memcmp(prog[0].x, "ab", 2) == 0);
   TEST_ASSERT(prog[1].code == Char);
   TEST_ASSERT(prog[1].c == 'b');
   TEST_ASSERT(prog[2].code == Match);
@@ -258,16 +239,10 @@ static int test_class(void)
 
   TEST_ASSERT(n == 2);
   TEST_ASSERT(prog[0].code == Range);
-  TEST_ASSERT(prog[0].s == 4);
-  char *block = (char*) prog[0].x;
-  TEST_ASSERT(block[0] == 'a');
-  TEST_ASSERT(block[1] == 'b');
-  TEST_ASSERT(block[2] == 'd');
-  TEST_ASSERT(block[3] == 'd');
-  TEST_ASSERT(block[4] == ' ');
-  TEST_ASSERT(block[5] == ' ');
-  TEST_ASSERT(block[6] == '-');
-  TEST_ASSERT(block[7] == '-');
+  unsigned char *set = (unsigned char *) prog[0].x;
+  for (int c = 0; c < 256; c++) {
+    TEST_ASSERT(charset_has(set, c) == (strchr("abd -", c) != NULL && c != 0));
+  }
   TEST_ASSERT(prog[1].code == Match);
 
   free_prog(prog, n);
@@ -281,16 +256,10 @@ static int test_nclass(void)
 
   TEST_ASSERT(n == 2);
   TEST_ASSERT(prog[0].code == NRange);
-  TEST_ASSERT(prog[0].s == 4);
-  char *block = (char*) prog[0].x;
-  TEST_ASSERT(block[0] == 'a');
-  TEST_ASSERT(block[1] == 'b');
-  TEST_ASSERT(block[2] == 'd');
-  TEST_ASSERT(block[3] == 'd');
-  TEST_ASSERT(block[4] == ' ');
-  TEST_ASSERT(block[5] == ' ');
-  TEST_ASSERT(block[6] == 'f');
-  TEST_ASSERT(block[7] == 'g');
+  unsigned char *set = (unsigned char *) prog[0].x;
+  for (int c = 0; c < 256; c++) {
+    TEST_ASSERT(charset_has(set, c) == (strchr("abd fg", c) != NULL && c != 0));
+  }
   TEST_ASSERT(prog[1].code == Match);
 
   free_prog(prog, n);
@@ -314,6 +283,31 @@ static int test_join_complex(void)
   return 0;
 }
 
+static int test_counted(void)
+{
+  size_t n;
+  instr *prog = recomp("(a){1,3}", &n);
+
+  // Every copy saves to the same slots.
+  TEST_ASSERT(numsaves(prog, n) == 2);
+  TEST_ASSERT(prog[0].code == Save);
+  TEST_ASSERT(prog[3].code == Split);
+  TEST_ASSERT(prog[3].y == prog + n - 1);
+  TEST_ASSERT(prog[n - 1].code == Match);
+  free_prog(prog, n);
+
+  // Each copy costs a split and a range, and no more.
+  prog = recomp("[a-z]{1,255}", &n);
+  TEST_ASSERT(n == 2 * 255);
+  free_prog(prog, n);
+
+  prog = recomp("a{0}", &n);
+  TEST_ASSERT(n == 1);
+  TEST_ASSERT(prog[0].code == Match);
+  free_prog(prog, n);
+  return 0;
+}
+
 void codegen_test(void)
 {
   smb_ut_group *group = su_create_test_group("test/codegen.c");
@@ -360,6 +354,9 @@ void codegen_test(void)
   smb_ut_test *join_complex = su_create_test("join_complex", test_join_complex);
   su_add_test(group, join_complex);
 
+  smb_ut_test *counted = su_create_test("counted", test_counted);
+  su_add_test(group, counted);
+
   su_run_group(group);
   su_delete_group(group);
 }
@@ -0,0 +1,223 @@
+/***************************************************************************//**
+
+  @file         dfa.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Lazy DFA tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+static char *regexes[] = {
+  "a", "a*", "a*a*", "(a*)b+", "a|b", "ab|a", "a|ab", "a*?b", "a+?",
+  "(a|ab)(c|bcd)(d*)", "[a-c]+x?", "[^a-c]*", "\\w+@\\w+", ".*b", "b.*?",
+};
+
+static char *inputs[] = {
+  "", "a", "b", "aa", "ab", "aab", "abcd", "abcdd", "xxabcdx", "aaac",
+  "foo@bar", "x@y z", "cab", "bbb", "zzzz",
+};
+
+/*
+  The DFA must report the same match as the Pike VM, for both anchored and
+  unanchored matching.
+ */
+static int test_agrees(void)
+{
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    scratch *s = newscratch(p);
+    dfa *d = newdfa(p, 64);
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      TEST_ASSERT(dfa_run(d, inputs[j], NULL) == run(p, s, inputs[j], NULL));
+      TEST_ASSERT(dfa_search(d, inputs[j], NULL, NULL) ==
+                  search(p, s, inputs[j], NULL, NULL));
+    }
+    free_dfa(d);
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  With a tiny cache, states are thrown away constantly.  The DFA should still
+  get the right answer (possibly by giving up and using the Pike VM).
+ */
+static int test_small_cache(void)
+{
+  program *p = compile("(a|b)*a(a|b)(a|b)(a|b)");
+  scratch *s = newscratch(p);
+  dfa *d = newdfa(p, 2);
+  char *inputs[] = {"abbbabab", "aaaa", "bbbb", "babbbbbbbbbbaabb"};
+
+  for (size_t i = 0; i < nelem(inputs); i++) {
+    TEST_ASSERT(dfa_run(d, inputs[i], NULL) == run(p, s, inputs[i], NULL));
+    TEST_ASSERT(dfa_search(d, inputs[i], NULL, NULL) ==
+                search(p, s, inputs[i], NULL, NULL));
+  }
+
+  free_dfa(d);
+  free_scratch(s);
+  free_program(p);
+  return 0;
+}
+
+/*
+  An unlimited cache holds many more states than its table starts with, so the
+  table has to grow as they are added.
+ */
+static int test_unlimited(void)
+{
+  program *p = compile("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)");
+  scratch *s = newscratch(p);
+  dfa *d = newdfa(p, SIZE_MAX);
+  size_t len = 4000;
+  char *input = malloc(len + 1);
+
+  srand(1);
+  for (size_t i = 0; i < len; i++) {
+    input[i] = "ab"[rand() % 2];
+  }
+  input[len] = '\0';
+  for (size_t i = 0; i < len; i += 500) {
+    TEST_ASSERT(dfa_run(d, input + i, NULL) == run(p, s, input + i, NULL));
+    TEST_ASSERT(dfa_search(d, input + i, NULL, NULL) ==
+                search(p, s, input + i, NULL, NULL));
+  }
+
+  free(input);
+  free_dfa(d);
+  free_scratch(s);
+  free_program(p);
+  return 0;
+}
+
+/*
+  The start (found by running reversed code) and captures (found by running the
+  Pike VM over the matched span) must be the same as search() finds.
+ */
+static int test_start(void)
+{
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    scratch *s = newscratch(p);
+    dfa *d = newdfa(p, 64);
+    TEST_ASSERT(p->rev != NULL);
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      size_t start1, start2, start3, *c1, *c2;
+      ssize_t m1 = search(p, s, inputs[j], &start1, &c1);
+      ssize_t m2 = dfa_search(d, inputs[j], &start2, &c2);
+      ssize_t m3 = dfa_search(d, inputs[j], &start3, NULL);
+      TEST_ASSERT(m1 == m2);
+      TEST_ASSERT(m1 == m3);
+      if (m1 != -1) {
+        TEST_ASSERT(start1 == start2);
+        TEST_ASSERT(start1 == start3);
+        for (size_t k = 0; k < p->nsave; k++) {
+          TEST_ASSERT(c1[k] == c2[k]);
+        }
+        free(c1);
+        free(c2);
+      }
+    }
+    free_dfa(d);
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  Bytes which no instruction tells apart share a class, and each class is a
+  run of consecutive bytes.
+ */
+static int test_classes(void)
+{
+  program *p = compile("[a-c]x");
+  // [\x00-`] [a-c] [d-w] [x] [y-\xff]
+  TEST_ASSERT(p->nclass == 5);
+  TEST_ASSERT(p->classes[0] == 0 && p->classes['`'] == 0);
+  TEST_ASSERT(p->classes['a'] == 1 && p->classes['c'] == 1);
+  TEST_ASSERT(p->classes['d'] == 2 && p->classes['w'] == 2);
+  TEST_ASSERT(p->classes['x'] == 3);
+  TEST_ASSERT(p->classes['y'] == 4 && p->classes[255] == 4);
+  free_program(p);
+
+  p = compile(".*");
+  TEST_ASSERT(p->nclass == 1);
+  free_program(p);
+
+  p = compile("\\xff");
+  TEST_ASSERT(p->nclass == 2);
+  TEST_ASSERT(p->classes[254] == 0 && p->classes[255] == 1);
+  free_program(p);
+  return 0;
+}
+
+static int test_captures(void)
+{
+  program *p = compile("(a*)b");
+  dfa *d = newdfa(p, 64);
+  size_t *capture;
+  size_t start;
+
+  TEST_ASSERT(dfa_run(d, "aab", &capture) == 3);
+  TEST_ASSERT(capture[0] == 0);
+  TEST_ASSERT(capture[1] == 2);
+  free(capture);
+
+  capture = (size_t *) 1;
+  TEST_ASSERT(dfa_run(d, "aac", &capture) == -1);
+  TEST_ASSERT(capture == NULL);
+
+  TEST_ASSERT(dfa_search(d, "ccab", &start, &capture) == 4);
+  TEST_ASSERT(start == 2);
+  TEST_ASSERT(capture[0] == 2);
+  TEST_ASSERT(capture[1] == 3);
+  free(capture);
+
+  free_dfa(d);
+  free_program(p);
+  return 0;
+}
+
+void dfa_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/dfa.c");
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  smb_ut_test *small_cache = su_create_test("small_cache", test_small_cache);
+  su_add_test(group, small_cache);
+
+  smb_ut_test *unlimited = su_create_test("unlimited", test_unlimited);
+  su_add_test(group, unlimited);
+
+  smb_ut_test *start = su_create_test("start", test_start);
+  su_add_test(group, start);
+
+  smb_ut_test *classes = su_create_test("classes", test_classes);
+  su_add_test(group, classes);
+
+  smb_ut_test *captures = su_create_test("captures", test_captures);
+  su_add_test(group, captures);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
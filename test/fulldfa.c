@@ -0,0 +1,132 @@
+/***************************************************************************//**
+
+  @file         fulldfa.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Full (minimized) DFA tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+static char *regexes[] = {
+  "a", "a*", "a*a*", "(a*)b+", "a|b", "ab|a", "a|ab", "a*?b", "a+?",
+  "(a|ab)(c|bcd)(d*)", "[a-c]+x?", "[^a-c]*", "\\w+@\\w+", ".*b", "b.*?",
+};
+
+static char *inputs[] = {
+  "", "a", "b", "aa", "ab", "aab", "abcd", "abcdd", "xxabcdx", "aaac",
+  "foo@bar", "x@y z", "cab", "bbb", "zzzz",
+};
+
+/*
+  The full DFA must report the same match end as run() and search().
+ */
+static int test_agrees(void)
+{
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    scratch *s = newscratch(p);
+    fulldfa *anchored = newfulldfa(p, true, 1024);
+    fulldfa *unanchored = newfulldfa(p, false, 1024);
+    TEST_ASSERT(anchored != NULL);
+    TEST_ASSERT(unanchored != NULL);
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      TEST_ASSERT(fulldfa_exec(anchored, inputs[j]) ==
+                  run(p, s, inputs[j], NULL));
+      TEST_ASSERT(fulldfa_exec(unanchored, inputs[j]) ==
+                  search(p, s, inputs[j], NULL, NULL));
+    }
+    free_fulldfa(anchored);
+    free_fulldfa(unanchored);
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  "a*a*" has distinct thread lists for "a" and "aa", but they behave the same,
+  so minimization should leave just one accepting state and a dead state.
+ */
+static int test_minimize(void)
+{
+  program *p = compile("a*a*");
+  fulldfa *f = newfulldfa(p, true, 1024);
+  TEST_ASSERT(fulldfa_nstates(f) == 2);
+  TEST_ASSERT(fulldfa_exec(f, "aaab") == 3);
+  free_fulldfa(f);
+  free_program(p);
+  return 0;
+}
+
+/*
+  Remembering the last n characters takes 2^n states, so construction should
+  give up under a small limit.
+ */
+static int test_too_big(void)
+{
+  program *p = compile("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)");
+  TEST_ASSERT(newfulldfa(p, true, 32) == NULL);
+  fulldfa *f = newfulldfa(p, true, 4096);
+  TEST_ASSERT(f != NULL);
+  TEST_ASSERT(fulldfa_exec(f, "bbabbbbbb") == 9);
+  free_fulldfa(f);
+  free_program(p);
+
+  // Limits below the lazy DFA's minimum are raised to it.
+  p = compile("a");
+  for (size_t maxstates = 0; maxstates < 2; maxstates++) {
+    f = newfulldfa(p, false, maxstates);
+    if (f != NULL) {
+      TEST_ASSERT(fulldfa_exec(f, "ba") == 2);
+      free_fulldfa(f);
+    }
+  }
+  free_program(p);
+  return 0;
+}
+
+static int test_binary(void)
+{
+  program *p = compile("\\x00[\\x80-\\xff]");
+  fulldfa *f = newfulldfa(p, false, 1024);
+  unsigned char buf[] = {'a', 0x00, 0x7f, 0x00, 0x90, 'b'};
+
+  TEST_ASSERT(fulldfa_exec_bytes(f, buf, sizeof(buf)) == 5);
+  TEST_ASSERT(fulldfa_exec_bytes(f, buf, 4) == -1);
+
+  free_fulldfa(f);
+  free_program(p);
+  return 0;
+}
+
+void fulldfa_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/fulldfa.c");
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  smb_ut_test *minimize = su_create_test("minimize", test_minimize);
+  su_add_test(group, minimize);
+
+  smb_ut_test *too_big = su_create_test("too_big", test_too_big);
+  su_add_test(group, too_big);
+
+  smb_ut_test *binary = su_create_test("binary", test_binary);
+  su_add_test(group, binary);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
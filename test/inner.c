@@ -0,0 +1,170 @@
+/***************************************************************************//**
+
+  @file         inner.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Inner literal tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+static int test_detect(void)
+{
+  char *found[] = {
+    "\\w+@example\\.com", "[0-9]+-[0-9]+", "(a|b)*xyz", "a*b", "\\s+END\\s",
+  };
+  char *none[] = {
+    "abc", "a|bc", "[a-z]+ing", ".*foo", "(ab)+", "a+?b*",
+  };
+
+  for (size_t i = 0; i < nelem(found); i++) {
+    program *p = compile(found[i]);
+    TEST_ASSERT(p->inner != NULL);
+    free_program(p);
+  }
+  for (size_t i = 0; i < nelem(none); i++) {
+    program *p = compile(none[i]);
+    TEST_ASSERT(p->inner == NULL);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  Searching with the inner literal must find the same match as the Pike VM.
+ */
+static int test_agrees(void)
+{
+  char *regexes[] = {
+    "(\\w+)@example\\.com", "[0-9]+-[0-9]+", "(a|b)*xyz", "a*?b", "(x*)yz",
+    "\\s+END\\s",
+  };
+  char *inputs[] = {
+    "", "b", "aab", "me@example.com", "x me@ex you@example.com!",
+    "@example.com a@example.co b@example.com", "12-34-56", "-1-2", "abxyzxyz",
+    "axyz bbxyz", "xxyz yz", "  END \tEND\n", "ENDEND END x", "yyz",
+  };
+
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    scratch *s = newscratch(p);
+    TEST_ASSERT(p->inner != NULL);
+
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      unsigned char *buf = (unsigned char *) inputs[j];
+      size_t len = strlen(inputs[j]);
+      size_t start1, start2, *c1, *c2;
+      ssize_t m1 = pikevm(p, s, buf, len, false, &start1, &c1);
+      ssize_t m2 = inner_search(p, s, buf, len, &start2, &c2);
+      TEST_ASSERT(m1 == m2);
+      if (m1 != -1) {
+        TEST_ASSERT(start1 == start2);
+        for (size_t k = 0; k < p->nsave; k++) {
+          TEST_ASSERT(c1[k] == c2[k]);
+        }
+        free(c1);
+        free(c2);
+      }
+    }
+
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  Reversed code matches the reverse of each string.
+ */
+static int test_reverse(void)
+{
+  PTree *tree = reparse("(ab)+c");
+  size_t n;
+  instr *code = codegen_reverse(tree, &n);
+  program *p = newprogram(code, n);
+  scratch *s = newscratch(p);
+
+  for (size_t i = 0; i < n; i++) {
+    TEST_ASSERT(code[i].code != Save);
+  }
+  TEST_ASSERT(run(p, s, "cbaba", NULL) == 5);
+  TEST_ASSERT(run(p, s, "abab", NULL) == -1);
+
+  free_scratch(s);
+  free_program(p);
+  free_tree(tree);
+  return 0;
+}
+
+/*
+  With many hits, and a rest which can run to the end of the input, the search
+  must stay linear.  It used to start over after each hit, which took thousands
+  of times as long as a single run of the VM here.
+ */
+static int test_many_hits(void)
+{
+  size_t len = 64000;
+  unsigned char *buf = malloc(len + 1);
+  for (size_t i = 0; i < len; i += 4) {
+    memcpy(buf + i, "1foo", 4);
+  }
+
+  program *p = compile("\\dfoo.*z");
+  scratch *s = newscratch(p);
+  size_t start1, start2;
+  TEST_ASSERT(p->inner != NULL);
+
+  clock_t t0 = clock();
+  TEST_ASSERT(pikevm(p, s, buf, len, false, NULL, NULL) == -1);
+  clock_t t1 = clock();
+  TEST_ASSERT(search_bytes(p, s, buf, len, NULL, NULL) == -1);
+  clock_t t2 = clock();
+  TEST_ASSERT(t2 - t1 <= 20 * (t1 - t0) + CLOCKS_PER_SEC / 10);
+
+  // Windows after the first one must still find the same match.
+  buf[len] = 'z';
+  buf[0] = 'x';
+  TEST_ASSERT(search_bytes(p, s, buf, len + 1, &start1, NULL) ==
+              pikevm(p, s, buf, len + 1, false, &start2, NULL));
+  TEST_ASSERT(start1 == start2 && start1 == 4);
+
+  free(buf);
+  free_scratch(s);
+  free_program(p);
+  return 0;
+}
+
+void inner_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/inner.c");
+
+  smb_ut_test *detect = su_create_test("detect", test_detect);
+  su_add_test(group, detect);
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  smb_ut_test *reverse = su_create_test("reverse", test_reverse);
+  su_add_test(group, reverse);
+
+  smb_ut_test *many_hits = su_create_test("many_hits", test_many_hits);
+  su_add_test(group, many_hits);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
@@ -0,0 +1,156 @@
+/***************************************************************************//**
+
+  @file         jit.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Native code tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+/*
+  Compare a program with native code against the same program without it, on
+  run_bytes() and search_bytes(), including captures.
+ */
+static int agree(program *native, program *interp, scratch *sn, scratch *si,
+                 const unsigned char *buf, size_t len)
+{
+  size_t *c1, *c2, s1, s2;
+  ssize_t m1 = run_bytes(native, sn, buf, len, &c1);
+  ssize_t m2 = run_bytes(interp, si, buf, len, &c2);
+  TEST_ASSERT(m1 == m2);
+  if (m1 != -1) {
+    TEST_ASSERT(memcmp(c1, c2, interp->nsave * sizeof(size_t)) == 0);
+  }
+  free(c1);
+  free(c2);
+
+  m1 = search_bytes(native, sn, buf, len, &s1, &c1);
+  m2 = search_bytes(interp, si, buf, len, &s2, &c2);
+  TEST_ASSERT(m1 == m2);
+  if (m1 != -1) {
+    TEST_ASSERT(s1 == s2);
+    TEST_ASSERT(memcmp(c1, c2, interp->nsave * sizeof(size_t)) == 0);
+  }
+  free(c1);
+  free(c2);
+  return 0;
+}
+
+static int test_agrees(void)
+{
+  char *regexes[] = {
+    "(a*)b", "(a|ab)(c|bcd)(d*)", "(a*)*b", "(a*?)(a*)", "((a)|(b))*c",
+    "(a|b)*a(a|b)", "x*", "(\\w+)@(\\w+)", "(abc|abd)(de)*f", "[^a-c]+d",
+    "a.c", "^(\\w+)$", "\\A(ab)+\\z", "b$\\n^c", "(a{2,3}){2}", "(a|ab)*c",
+  };
+  char *inputs[] = {
+    "", "b", "aab", "abcd", "abcdd", "xxabcdx", "aaac", "ababc", "bba",
+    "aaaa", "me@host", "x@", "xxx", "abdedef", "xabcf", "abcdedf", "abcd",
+    "xyzd", "a\nc", "ab\nc", "foo\nbar", "abab", "aaaaaa",
+  };
+
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *native = compile(regexes[i]);
+    program *interp = compile(regexes[i]);
+    jit_compile(native);
+    scratch *sn = newscratch(native);
+    scratch *si = newscratch(interp);
+
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      const unsigned char *buf = (const unsigned char *) inputs[j];
+      size_t len = strlen(inputs[j]);
+      if (agree(native, interp, sn, si, buf, len)) {
+        return 1;
+      }
+      size_t *c1, *c2;
+      ssize_t m1 = run(native, sn, inputs[j], &c1);
+      ssize_t m2 = execute(interp->code, interp->n, inputs[j], &c2);
+      TEST_ASSERT(m1 == m2);
+      free(c1);
+      free(c2);
+    }
+
+    free_scratch(sn);
+    free_scratch(si);
+    free_program(native);
+    free_program(interp);
+  }
+  return 0;
+}
+
+/*
+  Deep backtracking fills the initial stack, which must grow without changing
+  the result.  The input is also too long for the interpreted backtracker.
+ */
+static int test_long(void)
+{
+  size_t len = 100000;
+  unsigned char *buf = malloc(len);
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = "ab"[i % 2];
+  }
+  buf[len - 1] = 'c';
+
+  char *regexes[] = {"((a)|(b))*c", "(a|b)*?c", "(ab)*(b|c)", "b(\\w)*d"};
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *native = compile(regexes[i]);
+    program *interp = compile(regexes[i]);
+    TEST_ASSERT(!backtrack_fits(native->n, len));
+    scratch *sn = newscratch(native);
+    scratch *si = newscratch(interp);
+    if (jit_compile(native)) {
+      TEST_ASSERT(jit_fits(native->n, len));
+    }
+    if (agree(native, interp, sn, si, buf, len)) {
+      return 1;
+    }
+    free_scratch(sn);
+    free_scratch(si);
+    free_program(native);
+    free_program(interp);
+  }
+
+  free(buf);
+  return 0;
+}
+
+static int test_fits(void)
+{
+  TEST_ASSERT(jit_fits(10, 3));
+  TEST_ASSERT(jit_fits(10, 0));
+  TEST_ASSERT(jit_fits(1000, 4095));
+  TEST_ASSERT(!jit_fits(1000, 1000000));
+  return 0;
+}
+
+void jit_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/jit.c");
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  smb_ut_test *long_input = su_create_test("long", test_long);
+  su_add_test(group, long_input);
+
+  smb_ut_test *fits = su_create_test("fits", test_fits);
+  su_add_test(group, fits);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
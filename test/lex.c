@@ -26,6 +26,7 @@ static int test_lex_escapes(void)
   l.input = "\\(\\)\\[\\]\\+\\*\\?\\-\\^\\.\\n\\w\\|";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   TEST_ASSERT(l.tok.sym == CharSym);
@@ -74,9 +75,10 @@ static int test_lex_tokens(void)
 {
   Lexer l;
   l.tok = (Token){0};
-  l.input = "()[]+*?-^.|";
+  l.input = "()[]+*?-^.|$";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   TEST_ASSERT(l.tok.sym == LParen);
@@ -111,6 +113,9 @@ static int test_lex_tokens(void)
   nextsym(&l);
   TEST_ASSERT(l.tok.sym == Pipe);
   TEST_ASSERT(l.tok.c == '|');
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == Dollar);
+  TEST_ASSERT(l.tok.c == '$');
 
   return 0;
 }
@@ -122,6 +127,7 @@ static int test_lex_buffer(void)
   l.input = "abcdef";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   TEST_ASSERT(l.tok.sym == CharSym);
@@ -169,6 +175,118 @@ static int test_lex_buffer(void)
   return 0;
 }
 
+static int test_lex_hex(void)
+{
+  Lexer l;
+  l.tok = (Token){0};
+  l.input = "\\x00\\xfF\\x4\\x";
+  l.index = 0;
+  l.nbuf = 0;
+  l.inclass = false;
+
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT(l.tok.c == '\0');
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT((unsigned char) l.tok.c == 0xff);
+  // Without two hex digits, \x is just an x.
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT(l.tok.c == 'x');
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT(l.tok.c == '4');
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT(l.tok.c == 'x');
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == Eof);
+
+  return 0;
+}
+
+static int test_lex_counted(void)
+{
+  Lexer l;
+  l.tok = (Token){0};
+  l.input = "a{3}a{2,}a{0,15}a{,1}\\{1}";
+  l.index = 0;
+  l.nbuf = 0;
+  l.inclass = false;
+
+  nextsym(&l);
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == Counted);
+  TEST_ASSERT(l.min == 3 && l.max == 3);
+  nextsym(&l);
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == Counted);
+  TEST_ASSERT(l.min == 2 && l.max == REPEAT_INF);
+  nextsym(&l);
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == Counted);
+  TEST_ASSERT(l.min == 0 && l.max == 15);
+  // Anything else in braces is just characters.
+  nextsym(&l);
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT(l.tok.c == '{');
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT(l.tok.c == ',');
+  nextsym(&l);
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT(l.tok.c == '}');
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT(l.tok.c == '{');
+  nextsym(&l);
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == CharSym);
+  TEST_ASSERT(l.tok.c == '}');
+  nextsym(&l);
+  TEST_ASSERT(l.tok.sym == Eof);
+
+  return 0;
+}
+
+/*
+  A count is only a repetition where one can apply.  Elsewhere (in a class, at
+  the start, after another repetition, or before one), its '{' is a character.
+ */
+static int test_lex_counted_context(void)
+{
+  struct {
+    char *input;
+    size_t nth;  // index of the token for the '{'
+    TSym sym;
+  } cases[] = {
+    {"[x{1}]", 2, CharSym}, {"[a{1,2}]", 2, CharSym}, {"[^{2}]", 2, CharSym},
+    {"{2}", 0, CharSym}, {"x{2}*", 1, CharSym}, {"x{2}+", 1, CharSym},
+    {"x{2}{3}", 1, CharSym}, {"x*{2}", 2, CharSym}, {"({2})", 1, CharSym},
+    {"a|{2}", 2, CharSym}, {"x{2}?", 1, Counted}, {"[x]{2}", 3, Counted},
+    {"(x){2}", 3, Counted}, {"\\w{2}", 1, Counted}, {"x{2}{", 1, Counted},
+  };
+
+  for (size_t i = 0; i < nelem(cases); i++) {
+    Lexer l;
+    l.tok = (Token){0};
+    l.input = cases[i].input;
+    l.index = 0;
+    l.nbuf = 0;
+    l.inclass = false;
+
+    for (size_t j = 0; j <= cases[i].nth; j++) {
+      nextsym(&l);
+    }
+    TEST_ASSERT(l.tok.sym == cases[i].sym);
+    TEST_ASSERT(l.tok.c == '{');
+  }
+  return 0;
+}
+
 void lex_test(void)
 {
   smb_ut_group *group = su_create_test_group("test/lex.c");
@@ -182,6 +300,16 @@ void lex_test(void)
   smb_ut_test *lex_buffer = su_create_test("lex_buffer", test_lex_buffer);
   su_add_test(group, lex_buffer);
 
+  smb_ut_test *lex_hex = su_create_test("lex_hex", test_lex_hex);
+  su_add_test(group, lex_hex);
+
+  smb_ut_test *lex_counted = su_create_test("lex_counted", test_lex_counted);
+  su_add_test(group, lex_counted);
+
+  smb_ut_test *lex_counted_context = su_create_test("lex_counted_context",
+                                                    test_lex_counted_context);
+  su_add_test(group, lex_counted_context);
+
   su_run_group(group);
   su_delete_group(group);
 }
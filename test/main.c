@@ -24,6 +24,19 @@ int main(int argc, char *argv[])
   parse_test();
   codegen_test();
   pike_test();
+  dfa_test();
+  onepass_test();
+  backtrack_test();
+  fulldfa_test();
+  stream_test();
+  set_test();
+  prefilter_test();
+  inner_test();
+  batch_test();
+  packed_test();
+  optimize_test();
+  anchor_test();
+  jit_test();
 
   return 0;
 }
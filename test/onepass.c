@@ -0,0 +1,99 @@
+/***************************************************************************//**
+
+  @file         onepass.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        One-pass matching tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+static int test_detect(void)
+{
+  char *onepass[] = {
+    "a", "a*b", "(a*)b", "(\\w+)=(\\d+)", "a|b", "[a-c]+x?", "(a|b)*c",
+    "a*?b", "x(a|b)+",
+  };
+  char *notonepass[] = {
+    "a*a*", "(a|ab)", "a*a", "\\w+@\\w+\\.com|.*", "(a|b)*a(a|b)",
+  };
+
+  for (size_t i = 0; i < nelem(onepass); i++) {
+    program *p = compile(onepass[i]);
+    TEST_ASSERT(p->onepass != NULL);
+    free_program(p);
+  }
+  for (size_t i = 0; i < nelem(notonepass); i++) {
+    program *p = compile(notonepass[i]);
+    TEST_ASSERT(p->onepass == NULL);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  The one-pass matcher must find the same match and captures as the Pike VM.
+ */
+static int test_agrees(void)
+{
+  char *regexes[] = {
+    "(\\w+)=(\\d+)", "(a*)(b?)", "((a)|(b))*c", "(a+?)(b*)", "x(y)?z",
+    "key=(\\d+);end",
+  };
+  char *inputs[] = {
+    "", "key=42", "key=", "=1", "aab", "abab", "ababc", "bbc", "c", "aa",
+    "xz", "xyz", "xyyz", "key=42;end", "key=1;en", "key=1;enx",
+  };
+
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    scratch *s = newscratch(p);
+    TEST_ASSERT(p->onepass != NULL);
+
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      size_t *c1, *c2;
+      ssize_t m1 = run(p, s, inputs[j], &c1);
+      ssize_t m2 = pikevm(p, s, (unsigned char *) inputs[j], strlen(inputs[j]),
+                          true, NULL, &c2);
+      TEST_ASSERT(m1 == m2);
+      if (m1 != -1) {
+        for (size_t k = 0; k < p->nsave; k++) {
+          TEST_ASSERT(c1[k] == c2[k]);
+        }
+        free(c1);
+        free(c2);
+      }
+    }
+
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+void onepass_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/onepass.c");
+
+  smb_ut_test *detect = su_create_test("detect", test_detect);
+  su_add_test(group, detect);
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
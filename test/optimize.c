@@ -0,0 +1,224 @@
+/***************************************************************************//**
+
+  @file         optimize.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Peephole optimizer tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+/*
+  Jumps to jumps, and splits to jumps, go straight to the final target.  The
+  jumps which are no longer reached are removed.
+ */
+static int test_thread(void)
+{
+  size_t n;
+  char prog[] =
+    "    split L1 L2\n"
+    "L1:\n"
+    "    char a\n"
+    "    jump L3\n"
+    "L2:\n"
+    "    jump L4\n"
+    "L3:\n"
+    "    jump L4\n"
+    "L4:\n"
+    "    match\n";
+  instr *code = optimize(read_prog(prog, &n), &n);
+
+  TEST_ASSERT(n == 4);
+  TEST_ASSERT(code[0].code == Split);
+  TEST_ASSERT(code[0].x == code + 1);
+  TEST_ASSERT(code[0].y == code + 3);
+  TEST_ASSERT(code[1].code == Char);
+  TEST_ASSERT(code[2].code == Jump);
+  TEST_ASSERT(code[2].x == code + 3);
+  TEST_ASSERT(code[3].code == Match);
+
+  free_prog(code, n);
+  return 0;
+}
+
+/*
+  Splits with one target become jumps, and instructions which do nothing are
+  removed.
+ */
+static int test_nop(void)
+{
+  size_t n;
+  char prog[] =
+    "    save 0\n"
+    "    save 0\n"
+    "    split L1 L1\n"
+    "L1:\n"
+    "    range a z\n"
+    "    jump L2\n"
+    "L2:\n"
+    "    save 1\n"
+    "    match\n";
+  instr *code = optimize(read_prog(prog, &n), &n);
+
+  TEST_ASSERT(n == 4);
+  TEST_ASSERT(code[0].code == Save);
+  TEST_ASSERT(code[0].s == 0);
+  TEST_ASSERT(code[1].code == Range);
+  TEST_ASSERT(code[2].code == Save);
+  TEST_ASSERT(code[2].s == 1);
+  TEST_ASSERT(code[3].code == Match);
+
+  free_prog(code, n);
+  return 0;
+}
+
+/*
+  Optimized code matches the same way as the original.
+ */
+static int test_agrees(void)
+{
+  char prog[] =
+    "    save 0\n"
+    "L1:\n"
+    "    split L2 L3\n"
+    "L2:\n"
+    "    jump L4\n"
+    "L3:\n"
+    "    jump L5\n"
+    "L4:\n"
+    "    range a c\n"
+    "    jump L1\n"
+    "    char q\n"
+    "L5:\n"
+    "    save 1\n"
+    "    char x\n"
+    "    match\n";
+  char *inputs[] = {"", "x", "abcx", "abdx", "ccccx", "qx"};
+  char copy[sizeof(prog)];
+  size_t n1, n2;
+  memcpy(copy, prog, sizeof(prog)); // read_prog() modifies its input
+  instr *c1 = read_prog(prog, &n1);
+  instr *c2 = optimize(read_prog(copy, &n2), &n2);
+  program *p1 = newprogram(c1, n1), *p2 = newprogram(c2, n2);
+  scratch *s1 = newscratch(p1), *s2 = newscratch(p2);
+
+  TEST_ASSERT(n2 < n1);
+  for (size_t i = 0; i < nelem(inputs); i++) {
+    size_t *caps1, *caps2;
+    ssize_t m1 = run(p1, s1, inputs[i], &caps1);
+    ssize_t m2 = run(p2, s2, inputs[i], &caps2);
+    TEST_ASSERT(m1 == m2);
+    if (m1 != -1) {
+      TEST_ASSERT(caps1[0] == caps2[0] && caps1[1] == caps2[1]);
+      free(caps1);
+      free(caps2);
+    }
+  }
+
+  free_scratch(s1);
+  free_scratch(s2);
+  free_program(p1);
+  free_program(p2);
+  return 0;
+}
+
+/*
+  Runs of Chars become Strings, but not across an instruction which something
+  jumps to.
+ */
+static int test_strings(void)
+{
+  size_t n;
+  char prog[] =
+    "    char a\n"
+    "L1:\n"
+    "    char b\n"
+    "    char c\n"
+    "    char d\n"
+    "    split L1 L2\n"
+    "L2:\n"
+    "    match\n";
+  instr *code = optimize(read_prog(prog, &n), &n);
+
+  TEST_ASSERT(n == 6);
+  TEST_ASSERT(code[0].code == Char);
+  TEST_ASSERT(code[1].code == String);
+  TEST_ASSERT(code[1].c == 'b');
+  TEST_ASSERT(code[1].s == 3);
+  TEST_ASSERT(memcmp(code[1].x, "bcd", 3) == 0);
+  TEST_ASSERT(code[2].code == Char);
+  TEST_ASSERT(code[2].c == 'c');
+  TEST_ASSERT(code[3].code == Char);
+  TEST_ASSERT(code[3].c == 'd');
+
+  free_prog(code, n);
+  return 0;
+}
+
+/*
+  A String is written on one line, and read back with its Chars.
+ */
+static int test_roundtrip(void)
+{
+  size_t n1, n2;
+  instr *c1 = recomp("(Content-Length: )+;", &n1);
+  FILE *f = tmpfile();
+
+  write_prog(c1, n1, f);
+  rewind(f);
+  instr *c2 = fread_prog(f, &n2);
+  fclose(f);
+
+  TEST_ASSERT(n1 == n2);
+  for (size_t i = 0; i < n1; i++) {
+    TEST_ASSERT(c1[i].code == c2[i].code);
+    TEST_ASSERT(c1[i].c == c2[i].c);
+    if (c1[i].code == String) {
+      TEST_ASSERT(c1[i].s == c2[i].s);
+      TEST_ASSERT(memcmp(c1[i].x, c2[i].x, c1[i].s) == 0);
+    }
+    if (c1[i].code == Jump || c1[i].code == Split) {
+      TEST_ASSERT(c1[i].x - c1 == c2[i].x - c2);
+    }
+  }
+
+  free_prog(c1, n1);
+  free_prog(c2, n2);
+  return 0;
+}
+
+void optimize_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/optimize.c");
+
+  smb_ut_test *thread = su_create_test("thread", test_thread);
+  su_add_test(group, thread);
+
+  smb_ut_test *nop = su_create_test("nop", test_nop);
+  su_add_test(group, nop);
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  smb_ut_test *strings = su_create_test("strings", test_strings);
+  su_add_test(group, strings);
+
+  smb_ut_test *roundtrip = su_create_test("roundtrip", test_roundtrip);
+  su_add_test(group, roundtrip);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
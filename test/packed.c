@@ -0,0 +1,112 @@
+/***************************************************************************//**
+
+  @file         packed.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Packed code tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+static int test_size(void)
+{
+  TEST_ASSERT(sizeof(pinstr) == 8);
+  return 0;
+}
+
+/*
+  Targets are relative, and each distinct charset is stored once.
+ */
+static int test_encode(void)
+{
+  program *p = compile("([a-c]|x)*[a-c]\\d\\d");
+  pprog *vm = p->vm;
+  size_t ranges = 0;
+
+  TEST_ASSERT(vm->n == p->n);
+  for (size_t i = 0; i < vm->n; i++) {
+    instr *in = &p->code[i];
+    pinstr *pc = &vm->code[i];
+    TEST_ASSERT(pc->op == in->code);
+    if (in->code == Jump || in->code == Split) {
+      TEST_ASSERT(pc + pc->x == vm->code + (in->x - p->code));
+    }
+    if (in->code == Split) {
+      TEST_ASSERT(pc + pc->y == vm->code + (in->y - p->code));
+    }
+    if (in->code == Range) {
+      ranges++;
+      TEST_ASSERT(memcmp(vm->sets + pc->x * CHARSET_BYTES, in->x,
+                         CHARSET_BYTES) == 0);
+    }
+  }
+  TEST_ASSERT(ranges == 4);
+  TEST_ASSERT(vm->nsets == 2);
+
+  free_program(p);
+  return 0;
+}
+
+/*
+  Packed code still works after it has been copied somewhere else.
+ */
+static int test_relocate(void)
+{
+  char *inputs[] = {"", "zzb12", "xab99", "abc1", "c00x"};
+  program *p = compile("([a-c]|x)*[a-c]\\d\\d");
+  scratch *s = newscratch(p);
+  program q = *p;
+  pprog copy = *p->vm;
+
+  copy.code = calloc(copy.n, sizeof(pinstr));
+  copy.sets = calloc(copy.nsets, CHARSET_BYTES);
+  memcpy(copy.code, p->vm->code, copy.n * sizeof(pinstr));
+  memcpy(copy.sets, p->vm->sets, copy.nsets * CHARSET_BYTES);
+  q.vm = &copy;
+
+  for (size_t i = 0; i < nelem(inputs); i++) {
+    unsigned char *buf = (unsigned char *) inputs[i];
+    size_t len = strlen(inputs[i]);
+    size_t start1, start2;
+    ssize_t m1 = pikevm(p, s, buf, len, false, &start1, NULL);
+    ssize_t m2 = pikevm(&q, s, buf, len, false, &start2, NULL);
+    TEST_ASSERT(m1 == m2);
+    TEST_ASSERT(m1 == -1 || start1 == start2);
+  }
+
+  free(copy.code);
+  free(copy.sets);
+  free_scratch(s);
+  free_program(p);
+  return 0;
+}
+
+void packed_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/packed.c");
+
+  smb_ut_test *size = su_create_test("size", test_size);
+  su_add_test(group, size);
+
+  smb_ut_test *encode = su_create_test("encode", test_encode);
+  su_add_test(group, encode);
+
+  smb_ut_test *relocate = su_create_test("relocate", test_relocate);
+  su_add_test(group, relocate);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
@@ -26,6 +26,7 @@ static int test_TERM_CharSym(void)
   l.input = "a";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = TERM(&l);
@@ -48,6 +49,7 @@ static int test_TERM_Minus(void)
   l.input = "-";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = TERM(&l);
@@ -70,6 +72,7 @@ static int test_TERM_Caret(void)
   l.input = "^";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = TERM(&l);
@@ -92,6 +95,7 @@ static int test_TERM_Dot(void)
   l.input = ".";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = TERM(&l);
@@ -114,6 +118,7 @@ static int test_TERM_Special(void)
   l.input = "\\w";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = TERM(&l);
@@ -136,6 +141,7 @@ static int test_TERM_Subexpr(void)
   l.input = "(a+)";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = TERM(&l);
@@ -157,6 +163,7 @@ static int test_TERM_Class(void)
   l.input = "[abc]";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = TERM(&l);
@@ -179,6 +186,7 @@ static int test_TERM_NClass(void)
   l.input = "[^abc]";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = TERM(&l);
@@ -201,6 +209,7 @@ static int test_EXPR_Term(void)
   l.input = "a";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = EXPR(&l);
@@ -223,6 +232,7 @@ static int test_EXPR_Plus(void)
   l.input = "a+";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = EXPR(&l);
@@ -246,6 +256,7 @@ static int test_EXPR_PlusQuestion(void)
   l.input = "a+?";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = EXPR(&l);
@@ -270,6 +281,7 @@ static int test_EXPR_Star(void)
   l.input = "a*";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = EXPR(&l);
@@ -293,6 +305,7 @@ static int test_EXPR_StarQuestion(void)
   l.input = "a*?";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = EXPR(&l);
@@ -317,6 +330,7 @@ static int test_EXPR_Question(void)
   l.input = "a?";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = EXPR(&l);
@@ -340,6 +354,7 @@ static int test_EXPR_QuestionQuestion(void)
   l.input = "a??";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = EXPR(&l);
@@ -357,6 +372,32 @@ static int test_EXPR_QuestionQuestion(void)
   return 0;
 }
 
+static int test_EXPR_Counted(void)
+{
+  Lexer l;
+  l.tok = (Token){0};
+  l.input = "a{2,5}?";
+  l.index = 0;
+  l.nbuf = 0;
+  l.inclass = false;
+
+  nextsym(&l);
+  PTree *tree = EXPR(&l);
+  expect(Eof, &l);
+
+  TEST_ASSERT(tree != NULL);
+  TEST_ASSERT(tree->nt == EXPRnt);
+  TEST_ASSERT(tree->nchildren == 3);
+  TEST_ASSERT(tree->children[0]->nt == TERMnt);
+  TEST_ASSERT(tree->children[1]->tok.sym == Counted);
+  TEST_ASSERT(tree->children[1]->min == 2);
+  TEST_ASSERT(tree->children[1]->max == 5);
+  TEST_ASSERT(tree->children[2]->tok.sym == Question);
+
+  free_tree(tree);
+  return 0;
+}
+
 static int test_SUB_Normal(void)
 {
   Lexer l;
@@ -364,6 +405,7 @@ static int test_SUB_Normal(void)
   l.input = "a";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = SUB(&l);
@@ -385,6 +427,7 @@ static int test_SUB_Concat(void)
   l.input = "ab";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = SUB(&l);
@@ -410,6 +453,7 @@ static int test_REGEX_Normal(void)
   l.input = "a";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = REGEX(&l);
@@ -432,6 +476,7 @@ static int test_REGEX_Alternate(void)
   l.input = "a|b";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = REGEX(&l);
@@ -458,6 +503,7 @@ static int test_CLASS_range(void)
   l.input = "a-b";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = CLASS(&l);
@@ -482,6 +528,7 @@ static int test_CLASS_range_range(void)
   l.input = "a-b1-2";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = CLASS(&l);
@@ -514,6 +561,7 @@ static int test_CLASS_single(void)
     l.input = accept[i];
     l.index = 0;
     l.nbuf = 0;
+    l.inclass = false;
 
     nextsym(&l);
     PTree *tree = CLASS(&l);
@@ -537,6 +585,7 @@ static int test_CLASS_single_hyphen(void)
   l.input = "a-";
   l.index = 0;
   l.nbuf = 0;
+  l.inclass = false;
 
   nextsym(&l);
   PTree *tree = CLASS(&l);
@@ -555,6 +604,49 @@ static int test_CLASS_single_hyphen(void)
   return 0;
 }
 
+/*
+  Where a count can't be a repetition, its braces parse as characters, like
+  they did before counts were supported.
+ */
+static int test_counted_literal(void)
+{
+  // In a class, "{1}" is three more characters.
+  PTree *tree = reparse("[x{1}]");
+  PTree *term = tree->children[0]->children[0]->children[0];
+  TEST_ASSERT(term->nt == TERMnt && term->production == 3);
+  size_t nchars = 0;
+  for (PTree *c = term->children[1]; c != NULL;
+       c = c->nchildren > 1 ? c->children[1] : NULL) {
+    nchars++;
+  }
+  TEST_ASSERT(nchars == 4);
+  free_tree(tree);
+
+  // At the start, and before another repetition, "{2}" is characters, so the
+  // star applies to the "}".
+  char *regexes[] = {"{2}", "x{2}*", "[a{1,2}]"};
+  size_t nexprs[] = {3, 4, 1};
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    tree = reparse(regexes[i]);
+    size_t n = 0;
+    PTree *last = NULL;
+    for (PTree *sub = tree->children[0]; sub != NULL;
+         sub = sub->nchildren > 1 ? sub->children[1] : NULL) {
+      last = sub->children[0];
+      TEST_ASSERT(last->nchildren == 1 ||
+                  last->children[1]->tok.sym != Counted);
+      n++;
+    }
+    TEST_ASSERT(n == nexprs[i]);
+    if (i == 1) {
+      TEST_ASSERT(last->children[0]->children[0]->tok.c == '}');
+      TEST_ASSERT(last->children[1]->tok.sym == Star);
+    }
+    free_tree(tree);
+  }
+  return 0;
+}
+
 static int test_reparse(void)
 {
   PTree *tree = reparse("a+|b*");
@@ -637,6 +729,9 @@ void parse_test(void)
   smb_ut_test *EXPR_QuestionQuestion = su_create_test("EXPR_QuestionQuestion", test_EXPR_QuestionQuestion);
   su_add_test(group, EXPR_QuestionQuestion);
 
+  smb_ut_test *EXPR_Counted = su_create_test("EXPR_Counted", test_EXPR_Counted);
+  su_add_test(group, EXPR_Counted);
+
   smb_ut_test *SUB_Normal = su_create_test("SUB_Normal", test_SUB_Normal);
   su_add_test(group, SUB_Normal);
 
@@ -661,6 +756,10 @@ void parse_test(void)
   smb_ut_test *CLASS_single_hyphen = su_create_test("CLASS_single_hyphen", test_CLASS_single_hyphen);
   su_add_test(group, CLASS_single_hyphen);
 
+  smb_ut_test *counted_literal = su_create_test("counted_literal",
+                                                test_counted_literal);
+  su_add_test(group, counted_literal);
+
   smb_ut_test *reparse = su_create_test("reparse", test_reparse);
   su_add_test(group, reparse);
 
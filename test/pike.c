@@ -13,12 +13,24 @@
 
 *******************************************************************************/
 
+#include <string.h>
+
 #include "libstephen/ut.h"
 #include "tests.h"
 
 #include "regex.h"
 #include "regparse.h"
 
+/*
+  Run the Pike VM itself on a string.
+ */
+static ssize_t vm(program *p, scratch *s, char *input, bool anchored,
+                  size_t *start, size_t **saved)
+{
+  return pikevm(p, s, (unsigned char *) input, strlen(input), anchored, start,
+                saved);
+}
+
 static int test_any(void)
 {
   size_t n;
@@ -191,6 +203,322 @@ static int test_save_discard_stash(void)
   return 0;
 }
 
+/*
+  The VM keeps no state in the program, so a program can be shared between
+  several scratches (in real life, several threads) and is never modified.
+ */
+static int test_shared_program(void)
+{
+  program *p = compile("(a*)b");
+  scratch *s1 = newscratch(p);
+  scratch *s2 = newscratch(p);
+  instr *copy = calloc(p->n, sizeof(instr));
+  size_t *capture;
+  memcpy(copy, p->code, p->n * sizeof(instr));
+
+  TEST_ASSERT(run(p, s1, "aab", &capture) == 3);
+  TEST_ASSERT(capture[0] == 0);
+  TEST_ASSERT(capture[1] == 2);
+  free(capture);
+  TEST_ASSERT(run(p, s2, "ab", NULL) == 2);
+  TEST_ASSERT(run(p, s1, "c", NULL) == -1);
+  TEST_ASSERT(run(p, s2, "aaab", NULL) == 4);
+  TEST_ASSERT(memcmp(copy, p->code, p->n * sizeof(instr)) == 0);
+
+  free(copy);
+  free_scratch(s1);
+  free_scratch(s2);
+  free_program(p);
+  return 0;
+}
+
+/*
+  Captures from different threads live in rows of the same matrix, which is
+  reused between steps and between runs.  Make sure rows don't bleed into each
+  other when threads split, die, and match.  (These tests call the VM directly,
+  since run() and search() prefer other engines for short inputs.)
+ */
+static int test_capture_matrix(void)
+{
+  program *p = compile("(a|ab)(c|bcd)(d*)");
+  scratch *s = newscratch(p);
+  size_t *capture;
+
+  TEST_ASSERT(p->nsave == 6);
+  TEST_ASSERT(vm(p, s, "abcd", true, NULL, &capture) == 4);
+  TEST_ASSERT(capture[0] == 0 && capture[1] == 1);
+  TEST_ASSERT(capture[2] == 1 && capture[3] == 4);
+  TEST_ASSERT(capture[4] == 4 && capture[5] == 4);
+  free(capture);
+
+  TEST_ASSERT(vm(p, s, "abcdd", true, NULL, &capture) == 5);
+  TEST_ASSERT(capture[0] == 0 && capture[1] == 1);
+  TEST_ASSERT(capture[2] == 1 && capture[3] == 4);
+  TEST_ASSERT(capture[4] == 4 && capture[5] == 5);
+  free(capture);
+
+  TEST_ASSERT(vm(p, s, "abc", true, NULL, &capture) == 3);
+  TEST_ASSERT(capture[0] == 0 && capture[1] == 2);
+  TEST_ASSERT(capture[2] == 2 && capture[3] == 3);
+  TEST_ASSERT(capture[4] == 3 && capture[5] == 3);
+  free(capture);
+
+  capture = NULL;
+  TEST_ASSERT(vm(p, s, "ax", true, NULL, &capture) == -1);
+  TEST_ASSERT(capture == NULL);
+
+  free_scratch(s);
+  free_program(p);
+  return 0;
+}
+
+/*
+  Long alternations compile into long chains of split instructions.  The
+  epsilon closure used to recurse once per instruction in the chain.
+ */
+static int test_long_alternation(void)
+{
+  size_t nalt = 2000;
+  char *regex = calloc(nalt * 4, sizeof(char));
+  char *r = regex;
+  for (size_t i = 0; i < nalt; i++) {
+    *r++ = 'a' + i % 26;
+    *r++ = 'a' + (i / 26) % 26;
+    *r++ = 'a' + (i / 676) % 26;
+    *r++ = (i + 1 < nalt) ? '|' : '\0';
+  }
+  program *p = compile(regex);
+  scratch *s = newscratch(p);
+
+  TEST_ASSERT(vm(p, s, "aaa", true, NULL, NULL) == 3);
+  TEST_ASSERT(vm(p, s, "xyc", true, NULL, NULL) == 3); // the last alternative
+  TEST_ASSERT(vm(p, s, "zzz", true, NULL, NULL) == -1);
+
+  free_scratch(s);
+  free_program(p);
+  free(regex);
+  return 0;
+}
+
+static int test_search(void)
+{
+  program *p = compile("b+");
+  scratch *s = newscratch(p);
+  size_t start;
+
+  TEST_ASSERT(search(p, s, "aabbbc", &start, NULL) == 5);
+  TEST_ASSERT(start == 2);
+  TEST_ASSERT(search(p, s, "bb", &start, NULL) == 2);
+  TEST_ASSERT(start == 0);
+  TEST_ASSERT(search(p, s, "aaa", &start, NULL) == -1);
+  TEST_ASSERT(search(p, s, "", &start, NULL) == -1);
+  free_scratch(s);
+  free_program(p);
+
+  // Empty matches are found at the first index.
+  p = compile("a*");
+  s = newscratch(p);
+  TEST_ASSERT(search(p, s, "bbb", &start, NULL) == 0);
+  TEST_ASSERT(start == 0);
+  TEST_ASSERT(search(p, s, "", &start, NULL) == 0);
+  TEST_ASSERT(start == 0);
+  free_scratch(s);
+  free_program(p);
+
+  // The leftmost match wins, even over a higher priority alternative.
+  p = compile("bcd|ab");
+  s = newscratch(p);
+  TEST_ASSERT(search(p, s, "xabcd", &start, NULL) == 3);
+  TEST_ASSERT(start == 1);
+  free_scratch(s);
+  free_program(p);
+
+  return 0;
+}
+
+static int test_search_captures(void)
+{
+  program *p = compile("(a|ab)(c|bcd)");
+  scratch *s = newscratch(p);
+  size_t start;
+  size_t *capture;
+
+  TEST_ASSERT(vm(p, s, "xxabcdx", false, &start, &capture) == 6);
+  TEST_ASSERT(start == 2);
+  TEST_ASSERT(capture[0] == 2 && capture[1] == 3);
+  TEST_ASSERT(capture[2] == 3 && capture[3] == 6);
+  free(capture);
+
+  // Captures from threads started at earlier indices must not leak into
+  // threads started later.
+  TEST_ASSERT(vm(p, s, "aaac", false, &start, &capture) == 4);
+  TEST_ASSERT(start == 2);
+  TEST_ASSERT(capture[0] == 2 && capture[1] == 3);
+  TEST_ASSERT(capture[2] == 3 && capture[3] == 4);
+  free(capture);
+
+  free_scratch(s);
+  free_program(p);
+  return 0;
+}
+
+/*
+  Byte buffers may contain NUL, and bytes above 0x7f must compare as unsigned.
+ */
+static int test_binary(void)
+{
+  program *p = compile("a\\x00.[\\x80-\\xff]+");
+  scratch *s = newscratch(p);
+  unsigned char buf[] = {'x', 'a', 0x00, 0x00, 0x80, 0xff, 0xc3, 0x7f, 'a'};
+  size_t start;
+
+  TEST_ASSERT(run_bytes(p, s, buf + 1, 7, NULL) == 6);
+  TEST_ASSERT(run_bytes(p, s, buf + 1, 4, NULL) == 4);
+  TEST_ASSERT(run_bytes(p, s, buf + 1, 3, NULL) == -1);
+  TEST_ASSERT(run_bytes(p, s, buf, sizeof(buf), NULL) == -1);
+  TEST_ASSERT(search_bytes(p, s, buf, sizeof(buf), &start, NULL) == 7);
+  TEST_ASSERT(start == 1);
+  TEST_ASSERT(pikevm(p, s, buf, sizeof(buf), false, &start, NULL) == 7);
+  TEST_ASSERT(start == 1);
+
+  free_scratch(s);
+  free_program(p);
+  return 0;
+}
+
+/*
+  is_match() must agree with run() and search() on whether there is a match.
+ */
+static int test_is_match(void)
+{
+  char *regexes[] = {
+    "a", "a*", "(a*)b+", "ab|a", "a*?b", "(a|ab)(c|bcd)(d*)", "[a-c]+x?",
+    "[^a-c]*", "\\w+@\\w+", ".*b", "(ERROR): (\\w+)", "[0-9]+|x",
+  };
+  char *inputs[] = {
+    "", "a", "b", "aab", "abcd", "xxabcdx", "foo@bar", "x@y z", "cab", "zzzz",
+    "ERROR: x", "xERRORERROR: ok", "12", "ERROR:",
+  };
+
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    scratch *s = newscratch(p);
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      unsigned char *buf = (unsigned char *) inputs[j];
+      size_t len = strlen(inputs[j]);
+      TEST_ASSERT(is_match(p, s, buf, len, true) ==
+                  (run(p, s, inputs[j], NULL) != -1));
+      TEST_ASSERT(is_match(p, s, buf, len, false) ==
+                  (search(p, s, inputs[j], NULL, NULL) != -1));
+    }
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  run_into() and search_into() give the same captures as run() and search(),
+  in the caller's array, and leave it alone when nothing matches.
+ */
+static int test_into(void)
+{
+  program *p = compile("(a*)(b|c)");
+  scratch *s = newscratch(p);
+  char *inputs[] = {"aab", "c", "xxac", "x", ""};
+  size_t caps[4], *saved, start1, start2;
+
+  TEST_ASSERT(p->nsave == 4);
+  for (size_t i = 0; i < nelem(inputs); i++) {
+    unsigned char *buf = (unsigned char *) inputs[i];
+    size_t len = strlen(inputs[i]);
+
+    memset(caps, 0xff, sizeof(caps));
+    ssize_t m = run(p, s, inputs[i], &saved);
+    TEST_ASSERT(run_into(p, s, buf, len, caps) == m);
+    for (size_t k = 0; k < 4; k++) {
+      TEST_ASSERT(m == -1 ? caps[k] == (size_t) -1 : caps[k] == saved[k]);
+    }
+    free(saved);
+
+    memset(caps, 0xff, sizeof(caps));
+    m = search(p, s, inputs[i], &start1, &saved);
+    TEST_ASSERT(search_into(p, s, buf, len, &start2, caps) == m);
+    for (size_t k = 0; k < 4; k++) {
+      TEST_ASSERT(m == -1 ? caps[k] == (size_t) -1 : caps[k] == saved[k]);
+    }
+    TEST_ASSERT(m == -1 || start1 == start2);
+    free(saved);
+  }
+
+  free_scratch(s);
+  free_program(p);
+  return 0;
+}
+
+/*
+  A counted repetition matches just like the regex written out by hand.
+ */
+static int test_counted(void)
+{
+  char *counted[] = {
+    "a{2,4}", "a{2,4}?", "(ab){2,}", "(ab){2,}?", "x(a|b){3}y", "x[0-9]{0,2}",
+  };
+  char *written[] = {
+    "aaa?a?", "aaa??a??", "(ab)(ab)(ab)*", "(ab)(ab)(ab)*?",
+    "x(a|b)(a|b)(a|b)y", "x[0-9]?[0-9]?",
+  };
+  char *inputs[] = {
+    "", "a", "aaaaa", "xab", "abababa", "xabay", "xbbby", "x1234", "xx9",
+  };
+
+  for (size_t i = 0; i < nelem(counted); i++) {
+    program *p1 = compile(counted[i]), *p2 = compile(written[i]);
+    scratch *s1 = newscratch(p1), *s2 = newscratch(p2);
+
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      size_t start1, start2;
+      ssize_t m1 = search(p1, s1, inputs[j], &start1, NULL);
+      ssize_t m2 = search(p2, s2, inputs[j], &start2, NULL);
+      TEST_ASSERT(m1 == m2);
+      TEST_ASSERT(m1 == -1 || start1 == start2);
+    }
+
+    free_scratch(s1);
+    free_scratch(s2);
+    free_program(p1);
+    free_program(p2);
+  }
+
+  // Groups inside {0} keep their slots (which are never set), so the groups
+  // after them keep theirs too.  Slots are numbered in order of parentheses.
+  struct {
+    char *regex;
+    char *input;
+    size_t nsave;
+    size_t caps[6];
+  } groups[] = {
+    {"(a){0}(b)", "b", 4, {0, 0, 0, 1}},
+    {"((a){0}b)(c)", "bc", 6, {0, 0, 0, 1, 1, 2}},
+    {"(x(a)){0}(b)", "b", 6, {0, 0, 0, 0, 0, 1}},
+  };
+  for (size_t i = 0; i < nelem(groups); i++) {
+    program *p = compile(groups[i].regex);
+    scratch *s = newscratch(p);
+    size_t *caps;
+    TEST_ASSERT(p->nsave == groups[i].nsave);
+    TEST_ASSERT(run(p, s, groups[i].input, &caps) ==
+                (ssize_t) strlen(groups[i].input));
+    for (size_t k = 0; k < p->nsave; k++) {
+      TEST_ASSERT(caps[k] == groups[i].caps[k]);
+    }
+    free(caps);
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
 void pike_test(void)
 {
   smb_ut_group *group = su_create_test_group("test/pike.c");
@@ -222,6 +550,33 @@ void pike_test(void)
   smb_ut_test *save_discard_stash = su_create_test("save_discard_stash", test_save_discard_stash);
   su_add_test(group, save_discard_stash);
 
+  smb_ut_test *shared_program = su_create_test("shared_program", test_shared_program);
+  su_add_test(group, shared_program);
+
+  smb_ut_test *capture_matrix = su_create_test("capture_matrix", test_capture_matrix);
+  su_add_test(group, capture_matrix);
+
+  smb_ut_test *long_alternation = su_create_test("long_alternation", test_long_alternation);
+  su_add_test(group, long_alternation);
+
+  smb_ut_test *search = su_create_test("search", test_search);
+  su_add_test(group, search);
+
+  smb_ut_test *search_captures = su_create_test("search_captures", test_search_captures);
+  su_add_test(group, search_captures);
+
+  smb_ut_test *binary = su_create_test("binary", test_binary);
+  su_add_test(group, binary);
+
+  smb_ut_test *is_match = su_create_test("is_match", test_is_match);
+  su_add_test(group, is_match);
+
+  smb_ut_test *into = su_create_test("into", test_into);
+  su_add_test(group, into);
+
+  smb_ut_test *counted = su_create_test("counted", test_counted);
+  su_add_test(group, counted);
+
   su_run_group(group);
   su_delete_group(group);
 }
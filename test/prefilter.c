@@ -0,0 +1,118 @@
+/***************************************************************************//**
+
+  @file         prefilter.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Prefilter tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+static int test_detect(void)
+{
+  unsigned char *buf = (unsigned char *) "xxERRORERROR: y";
+  size_t len = strlen((char *) buf);
+
+  program *p = compile("(ERROR): (\\w+)");
+  TEST_ASSERT(p->prefilter != NULL);
+  TEST_ASSERT(prefilter_next(p->prefilter, buf, len, 0) == 7);
+  TEST_ASSERT(prefilter_next(p->prefilter, buf, len, 8) == len + 1);
+  free_program(p);
+
+  p = compile("[0-9]+|x");
+  TEST_ASSERT(p->prefilter != NULL);
+  TEST_ASSERT(prefilter_first(p->prefilter, '5'));
+  TEST_ASSERT(prefilter_first(p->prefilter, 'x'));
+  TEST_ASSERT(!prefilter_first(p->prefilter, 'E'));
+  TEST_ASSERT(prefilter_next(p->prefilter, buf, len, 0) == 0);
+  TEST_ASSERT(prefilter_next(p->prefilter, buf, len, 2) == len + 1);
+  free_program(p);
+
+  // These may match the empty string, or begin with any byte.
+  p = compile("a*");
+  TEST_ASSERT(p->prefilter == NULL);
+  free_program(p);
+  p = compile(".b");
+  TEST_ASSERT(p->prefilter == NULL);
+  free_program(p);
+  return 0;
+}
+
+/*
+  Searching with the prefilter must find the same match as without it, with
+  both the Pike VM and the backtracker.
+ */
+static int test_agrees(void)
+{
+  char *regexes[] = {
+    "(ab)+c", "a(b|c)d", "[xy]+z", "(ERROR): (\\w+)", "b|cd",
+  };
+  char *inputs[] = {
+    "", "abc", "xxababcx", "acd abd", "yyxz", "ERROR: disk", "ERROR:  x",
+    "xERRORERROR: ok", "zzzzcd", "cb",
+  };
+
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    program q = *p;
+    scratch *s = newscratch(p);
+    bitstate *b = newbitstate(p);
+    uint32_t *matched = calloc(p->nsave + 1, sizeof(uint32_t));
+    q.prefilter = NULL;
+    TEST_ASSERT(p->prefilter != NULL);
+
+    for (size_t j = 0; j < nelem(inputs); j++) {
+      unsigned char *buf = (unsigned char *) inputs[j];
+      size_t len = strlen(inputs[j]);
+      size_t start1, start2, *c1, *c2;
+      ssize_t m1 = pikevm(&q, s, buf, len, false, &start1, &c1);
+      ssize_t m2 = pikevm(p, s, buf, len, false, &start2, &c2);
+      ssize_t m3 = backtrack(p, b, buf, len, false, matched);
+      TEST_ASSERT(m1 == m2);
+      TEST_ASSERT(m1 == m3);
+      if (m1 != -1) {
+        TEST_ASSERT(start1 == start2);
+        TEST_ASSERT(start1 == matched[p->nsave]);
+        for (size_t k = 0; k < p->nsave; k++) {
+          TEST_ASSERT(c1[k] == c2[k]);
+          TEST_ASSERT(c1[k] == matched[k]);
+        }
+        free(c1);
+        free(c2);
+      }
+    }
+
+    free(matched);
+    free_bitstate(b);
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+void prefilter_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/prefilter.c");
+
+  smb_ut_test *detect = su_create_test("detect", test_detect);
+  su_add_test(group, detect);
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
@@ -0,0 +1,111 @@
+/***************************************************************************//**
+
+  @file         set.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Regex set tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+static char *regexes[] = {
+  "(a*)b", "(a|ab)(c|bcd)(d*)", "a*?b", "[a-c]+x?", "\\w+@\\w+", ".*b",
+  "x", "ab|a",
+};
+
+static char *inputs[] = {
+  "", "a", "b", "aa", "ab", "aab", "abcd", "xxabcdx", "aaac", "foo@bar",
+  "x@y z", "cab", "zzzz",
+};
+
+/*
+  A regex is in the result exactly when run() (or search()) finds a match.
+ */
+static int test_agrees(void)
+{
+  regexset *rs = newregexset(regexes, nelem(regexes));
+  program *p[nelem(regexes)];
+  scratch *s[nelem(regexes)];
+  size_t ids[nelem(regexes)];
+
+  TEST_ASSERT(regexset_size(rs) == nelem(regexes));
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    p[i] = compile(regexes[i]);
+    s[i] = newscratch(p[i]);
+  }
+
+  for (size_t j = 0; j < nelem(inputs); j++) {
+    unsigned char *buf = (unsigned char *) inputs[j];
+    for (int anchored = 0; anchored < 2; anchored++) {
+      size_t n = regexset_match(rs, buf, strlen(inputs[j]), anchored, ids);
+      size_t k = 0;
+      for (size_t i = 0; i < nelem(regexes); i++) {
+        ssize_t m = anchored ? run(p[i], s[i], inputs[j], NULL)
+                             : search(p[i], s[i], inputs[j], NULL, NULL);
+        if (m != -1) {
+          TEST_ASSERT(k < n && ids[k] == i);
+          k++;
+        }
+      }
+      TEST_ASSERT(k == n);
+    }
+  }
+
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    free_scratch(s[i]);
+    free_program(p[i]);
+  }
+  free_regexset(rs);
+  return 0;
+}
+
+/*
+  Each match instruction carries the index of its regex.
+ */
+static int test_codegen(void)
+{
+  char *set[] = {"a", "b", "c"};
+  size_t n;
+  instr *code = recomp_set(set, nelem(set), &n);
+  size_t nmatch = 0;
+
+  TEST_ASSERT(code[0].code == Split);
+  for (size_t i = 0; i < n; i++) {
+    if (code[i].code == Match) {
+      TEST_ASSERT(code[i].s == nmatch);
+      TEST_ASSERT(code[i - 1].c == set[nmatch][0]);
+      nmatch++;
+    }
+  }
+  TEST_ASSERT(nmatch == 3);
+
+  free_prog(code, n);
+  return 0;
+}
+
+void set_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/set.c");
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  smb_ut_test *codegen = su_create_test("codegen", test_codegen);
+  su_add_test(group, codegen);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
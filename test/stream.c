@@ -0,0 +1,197 @@
+/***************************************************************************//**
+
+  @file         stream.c
+
+  @author       Stephen Brennan
+
+  @date         Created Thursday, 15 October 2026
+
+  @brief        Streaming matcher tests.
+
+  @copyright    Copyright (c) 2016, Stephen Brennan.  Released under the Revised
+                BSD License.  See LICENSE.txt for details.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include "libstephen/ut.h"
+#include "tests.h"
+
+#include "regex.h"
+#include "regparse.h"
+
+/*
+  Feed a string to a stream in chunks of the given size, then end it.
+ */
+static void feed(stream *st, char *input, size_t chunk)
+{
+  size_t len = strlen(input);
+  for (size_t i = 0; i < len; i += chunk) {
+    size_t n = (len - i < chunk) ? len - i : chunk;
+    if (stream_feed(st, (unsigned char *) input + i, n) != StreamMore) {
+      return;
+    }
+  }
+  stream_end(st);
+}
+
+/*
+  However the input is split, a stream must find the same match (and captures)
+  as run() or search() on the whole input.
+ */
+static int test_agrees(void)
+{
+  char *regexes[] = {
+    "(a*)b", "(a|ab)(c|bcd)(d*)", "(a*?)(a*)", "((a)|(b))*c", "a+?", "x*",
+    "(\\w+)@(\\w+)",
+  };
+  char *inputs[] = {
+    "", "b", "aab", "abcd", "abcdd", "xxabcdx", "aaac", "ababc", "aaaa",
+    "me@host", "x@", "xxx",
+  };
+
+  for (size_t i = 0; i < nelem(regexes); i++) {
+    program *p = compile(regexes[i]);
+    scratch *s = newscratch(p);
+    for (int anchored = 0; anchored < 2; anchored++) {
+      stream *st = newstream(p, anchored);
+      for (size_t j = 0; j < nelem(inputs); j++) {
+        size_t start1, start2, *c1, *c2;
+        ssize_t m1 = anchored ? run(p, s, inputs[j], &c1)
+                              : search(p, s, inputs[j], &start1, &c1);
+        for (size_t chunk = 1; chunk <= 4; chunk++) {
+          stream_reset(st);
+          feed(st, inputs[j], chunk);
+          TEST_ASSERT(stream_result(st, &start2, &c2) == m1);
+          if (m1 != -1) {
+            TEST_ASSERT(anchored ? start2 == 0 : start2 == start1);
+            for (size_t k = 0; k < p->nsave; k++) {
+              TEST_ASSERT(c1[k] == c2[k]);
+            }
+            free(c2);
+          }
+        }
+        if (m1 != -1) {
+          free(c1);
+        }
+      }
+      free_stream(st);
+    }
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+/*
+  A match is reported as soon as nothing could replace it, without waiting for
+  more input.
+ */
+static int test_early(void)
+{
+  program *p = compile("a(b|c)");
+  stream *st = newstream(p, false);
+  size_t start;
+
+  TEST_ASSERT(stream_feed(st, (unsigned char *) "xxxa", 4) == StreamMore);
+  TEST_ASSERT(stream_feed(st, (unsigned char *) "bzzz", 4) == StreamMatch);
+  TEST_ASSERT(stream_result(st, &start, NULL) == 5);
+  TEST_ASSERT(start == 3);
+  // Once decided, further input is ignored.
+  TEST_ASSERT(stream_feed(st, (unsigned char *) "ab", 2) == StreamMatch);
+  TEST_ASSERT(stream_end(st) == StreamMatch);
+
+  free_stream(st);
+  free_program(p);
+  return 0;
+}
+
+/*
+  Offsets are in stream coordinates, across many chunks.
+ */
+static int test_offsets(void)
+{
+  program *p = compile("(a+)b");
+  stream *st = newstream(p, false);
+  size_t start, *capture;
+  unsigned char zeros[1000] = {0};
+
+  for (int i = 0; i < 100; i++) {
+    TEST_ASSERT(stream_feed(st, zeros, sizeof(zeros)) == StreamMore);
+  }
+  TEST_ASSERT(stream_feed(st, (unsigned char *) "aa", 2) == StreamMore);
+  TEST_ASSERT(stream_feed(st, (unsigned char *) "ab", 2) == StreamMatch);
+  TEST_ASSERT(stream_result(st, &start, &capture) == 100004);
+  TEST_ASSERT(start == 100000);
+  TEST_ASSERT(capture[0] == 100000 && capture[1] == 100003);
+  free(capture);
+
+  stream_reset(st);
+  TEST_ASSERT(stream_feed(st, zeros, sizeof(zeros)) == StreamMore);
+  TEST_ASSERT(stream_end(st) == StreamFail);
+  TEST_ASSERT(stream_result(st, &start, &capture) == -1);
+  TEST_ASSERT(capture == NULL);
+
+  free_stream(st);
+  free_program(p);
+  return 0;
+}
+
+/*
+  Moving the base offset forward must not change any capture, including ones
+  which were never set.
+ */
+static int test_rebase(void)
+{
+  struct {
+    char *regex;
+    char *input;
+  } cases[] = {
+    {"(a)|b", "xxxxxxxxb"}, {"(a+)(b)?c", "xxxxxaaaaaaaac"},
+    {"((a)|(b))+c", "xxbbbbbbaabc"}, {"(x)*y", "xxxxxxxy"},
+  };
+
+  for (size_t i = 0; i < nelem(cases); i++) {
+    program *p = compile(cases[i].regex);
+    scratch *s = newscratch(p);
+    size_t start1, start2, *c1, *c2;
+    ssize_t m1 = search(p, s, cases[i].input, &start1, &c1);
+
+    for (size_t chunk = 1; chunk <= 3; chunk++) {
+      stream *st = newstream(p, false);
+      stream_rebase_at(st, 4);
+      feed(st, cases[i].input, chunk);
+      TEST_ASSERT(stream_result(st, &start2, &c2) == m1);
+      TEST_ASSERT(m1 != -1 && start1 == start2);
+      TEST_ASSERT(memcmp(c1, c2, p->nsave * sizeof(size_t)) == 0);
+      free(c2);
+      free_stream(st);
+    }
+
+    free(c1);
+    free_scratch(s);
+    free_program(p);
+  }
+  return 0;
+}
+
+void stream_test(void)
+{
+  smb_ut_group *group = su_create_test_group("test/stream.c");
+
+  smb_ut_test *agrees = su_create_test("agrees", test_agrees);
+  su_add_test(group, agrees);
+
+  smb_ut_test *early = su_create_test("early", test_early);
+  su_add_test(group, early);
+
+  smb_ut_test *offsets = su_create_test("offsets", test_offsets);
+  su_add_test(group, offsets);
+
+  smb_ut_test *rebase = su_create_test("rebase", test_rebase);
+  su_add_test(group, rebase);
+
+  su_run_group(group);
+  su_delete_group(group);
+}
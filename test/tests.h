@@ -20,5 +20,18 @@ void parse_test(void);
 void lex_test(void);
 void codegen_test(void);
 void pike_test(void);
+void dfa_test(void);
+void onepass_test(void);
+void backtrack_test(void);
+void fulldfa_test(void);
+void stream_test(void);
+void set_test(void);
+void prefilter_test(void);
+void inner_test(void);
+void batch_test(void);
+void packed_test(void);
+void optimize_test(void);
+void anchor_test(void);
+void jit_test(void);
 
 #endif//REGEX_TEST_H